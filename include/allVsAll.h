@@ -0,0 +1,184 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_ALL_VS_ALL_H
+#define GBWT_QUERY_ALL_VS_ALL_H
+
+#include<parallelQuery.h>
+#include<groupedMatches.h>
+#include<vector>
+#include<string>
+#include<fstream>
+#include<stdexcept>
+#include<cstdio>
+#include<omp.h>
+
+//All-versus-all matching of the paths of the index, in the spirit of PBWT all-vs-all IBD calling.
+//An indexed path needs no virtual insertion: its own rows, reached by LF from its endmarker row, are insertion positions
+//of the path (it is inserted right above itself) and the suffix of its row at Qs[k] is (sequence, k), see ownRowInsertion.
+//The path itself and its reverse are left out of the lcps (see leaveOutLcps) and of the reported matches.
+//allVsAll runs the paths in chunks on OpenMP threads and appends one record per path to a file, a checkpoint written
+//after every chunk lets an interrupted job continue from the last finished chunk.
+
+//Qs, a, and s of indexed sequence seq from its own rows, the path is written to Q
+void ownRowInsertion(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const gbwt::size_type seq, gbwt::vector_type& Q, QueryScratch& scratch) {
+    std::vector<gbwt::size_type> rows;
+    Q.clear();
+    gbwt::edge_type position = lfg.LF({gbwt::ENDMARKER, seq});
+    while (position.first != gbwt::ENDMARKER) {
+        Q.push_back(position.first);
+        rows.push_back(position.second);
+        position = lfg.LF(position);
+    }
+    gbwt::vector_type& Qs = scratch.Qs;
+    std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s;
+    Qs.resize(Q.size() + 1);
+    a.resize(Q.size() + 1);
+    s.resize(Q.size() + 1);
+    for (gbwt::size_type k = 0; k < Q.size(); ++k) {
+        Qs[k] = Q[Q.size()-1-k];
+        a[k] = rows[Q.size()-1-k];
+        //the row of Q[j] has sequence offset |Q|-1-j
+        s[k] = r.pack(seq, k);
+    }
+    Qs[Q.size()] = gbwt::ENDMARKER;
+    a[Q.size()] = seq;
+    s[Q.size()] = r.pack(seq, Q.size());
+}
+
+//both orientations of every path except path, the Remaining of leaveOutLcps
+struct OtherPaths {
+    gbwt::size_type path;
+
+    bool contains(gbwt::size_type sequence) const { return gbwt::Path::id(sequence) != this->path; }
+    bool nodeHasMembers(const FastLCP&, gbwt::node_type) const { return true; }
+};
+
+//set maximal matches (L == 0) or long matches of length at least L of indexed sequence seq against the other paths,
+//with version 3 lcps or version 4 lcps if ct is given. Matches on reverse paths are in forward path coordinates,
+//see CanonicalOrientationSink. A long match of two paths is the same match seen from either, so long matches are only
+//written for other paths with a larger id. Q is a buffer for the path
+template<class Sink>
+void allVsAllSequence(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::size_type L, const gbwt::size_type seq,
+        QueryScratch& scratch, gbwt::vector_type& Q, Sink& matches, const HotNodeCache* hot = nullptr) {
+    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    ownRowInsertion(lfg, r, seq, Q, scratch);
+    if (Q.empty()) { return; }
+    const gbwt::vector_type& Qs = scratch.Qs;
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s;
+    std::vector<gbwt::size_type>& lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    if (ct) { lcpAboveBelowCT(lfg, l, *ct, a, s, Qs, lcpa, lcpb); }
+    else { lcpAboveBelowLFGBWT(lfg, a, Qs, lcpa, lcpb); }
+
+    gbwt::size_type path = gbwt::Path::id(seq);
+    auto canonical = bothOrientations(l, matches);
+    if (L == 0) {
+        OtherPaths others{path};
+        leaveOutLcps(lfg, r, l, others, a, s, Qs, lcpa, lcpb);
+        auto sink = [&] (gbwt::size_type start, gbwt::size_type len, gbwt::size_type other, gbwt::size_type otherStart) {
+            if (gbwt::Path::id(other) != path) { canonical(start, len, other, otherStart); }
+        };
+        gbwt::size_type prev = 0, len;
+        for (gbwt::size_type k = 0; k < Qs.size(); ++k){
+            len = std::max(lcpa[k], lcpb[k]);
+            if (len != 0 && len >= prev)
+                AddMatchesFastLCPLFGBWT(lfg, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], sink, hot);
+            prev = len;
+        }
+    }
+    else {
+        auto sink = [&] (gbwt::size_type start, gbwt::size_type len, gbwt::size_type other, gbwt::size_type otherStart) {
+            if (gbwt::Path::id(other) > path) { canonical(start, len, other, otherStart); }
+        };
+        longMatchSegmentLFGBWT(lfg, r, l, L, Qs, a, s, lcpa, lcpb, Qs.size()-1, 0, scratch.inBlock, sink, hot);
+    }
+}
+
+//calls report(sequence, matches) for every record of an allVsAll file, matches is a PackedGroupedMatches
+template<class Report>
+void readAllVsAll(std::istream& in, Report report) {
+    while (in.peek() != std::char_traits<char>::eof()) {
+        gbwt::size_type seq;
+        PackedGroupedMatches matches;
+        sdsl::load(seq, in);
+        matches.load(in);
+        report(seq, matches);
+    }
+}
+
+//writes the all-versus-all matches of every path (its forward sequence) to filename, set maximal matches if L == 0 and long
+//matches of length at least L otherwise, see allVsAllSequence. Records are the sequence id followed by its matches as
+//delta encoded PackedGroupedMatches, in sequence order, see readAllVsAll. chunkSize paths are queried in parallel between
+//checkpoints (0 for 16 per thread), filename.checkpoint holds L, the number of finished paths, and the bytes written
+//for them. If it exists the job continues after the finished paths, the records are deterministic so a record cut
+//off by an interruption is overwritten by the same bytes
+void allVsAll(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::size_type L,
+        const std::string& filename, gbwt::size_type chunkSize = 0, const HotNodeCache* hot = nullptr) {
+    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (chunkSize == 0) { chunkSize = 16 * omp_get_max_threads(); }
+    const std::string checkpoint = filename + ".checkpoint";
+    gbwt::size_type paths = lfg.sequences() / 2, done = 0, bytes = 0;
+    {
+        std::ifstream in(checkpoint);
+        gbwt::size_type checkpointL;
+        if (in >> checkpointL >> done >> bytes) {
+            if (checkpointL != L) { throw std::invalid_argument("allVsAll: checkpoint " + checkpoint + " is for a different L!"); }
+        }
+        else { done = bytes = 0; }
+    }
+    std::fstream out;
+    if (done) { out.open(filename, std::ios::in | std::ios::out | std::ios::binary); }
+    else { out.open(filename, std::ios::out | std::ios::trunc | std::ios::binary); }
+    if (!out.is_open()) { throw std::invalid_argument("allVsAll: " + filename + " failed to open for writing!"); }
+    out.seekp(bytes);
+
+    std::vector<QueryScratch> scratch(omp_get_max_threads());
+    std::vector<gbwt::vector_type> Q(omp_get_max_threads());
+    std::vector<GroupedMatches> matches;
+    while (done < paths) {
+        gbwt::size_type n = std::min(chunkSize, paths - done);
+        matches.assign(n, GroupedMatches());
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (gbwt::size_type i = 0; i < n; ++i) {
+            gbwt::size_type thread = omp_get_thread_num();
+            allVsAllSequence(lfg, r, l, ct, L, gbwt::Path::encode(done + i, false), scratch[thread], Q[thread], matches[i], hot);
+        }
+        for (gbwt::size_type i = 0; i < n; ++i) {
+            bytes += sdsl::serialize(gbwt::Path::encode(done + i, false), out);
+            bytes += PackedGroupedMatches(matches[i], true).serialize(out);
+        }
+        out.flush();
+        done += n;
+        //written aside and renamed over the old checkpoint, so a crash while writing leaves the previous checkpoint intact
+        {
+            std::ofstream tmp(checkpoint + ".tmp");
+            tmp << L << ' ' << done << ' ' << bytes << '\n';
+            if (!tmp.flush()) { throw std::runtime_error("allVsAll: could not write " + checkpoint + ".tmp!"); }
+        }
+        if (std::rename((checkpoint + ".tmp").c_str(), checkpoint.c_str()) != 0) { throw std::runtime_error("allVsAll: could not replace " + checkpoint + "!"); }
+    }
+}
+
+#endif //GBWT_QUERY_ALL_VS_ALL_H
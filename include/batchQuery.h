@@ -0,0 +1,202 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_BATCHQUERY_H
+#define GBWT_QUERY_BATCHQUERY_H
+
+#include<queryEngine.h>
+#include<vector>
+#include<atomic>
+#include<numeric>
+#include<memory>
+#include<stdexcept>
+#include<cassert>
+#include<algorithm>
+#include<omp.h>
+
+//Batch query API. Queries are answered by the OpenMP threads of a QueryEngine, omp_get_max_threads() at the time of the batch.
+//The engine reserves scratch for that many threads before the parallel region, so the first queries of the batch do not allocate.
+//Tasks are sorted by estimated cost (query length) and dealt round robin to one deque per thread,
+//a thread takes its own tasks from the front (most expensive first) and steals from the back of other deques when empty.
+//Results are delivered as deliver(i, matches) in input order: a finished query marks its slot ready and the thread
+//that wins the delivery flag delivers every ready query at the front of the order, so deliver is never called concurrently.
+//matches is a std::vector<QueryEngine::match_type> that is freed after deliver returns.
+//With groupSize > 1 queries are sorted lexicographically and each task runs groupSize consecutive queries on one thread,
+//so queries sharing a prefix reuse its virtual insertion (see sharedPrefixInsertion) at the cost of coarser load balancing.
+
+//work stealing deque over a fixed slice of tasks, head and tail are packed into one atomic word
+class BatchTaskDeque {
+    public:
+    typedef gbwt::size_type size_type;
+
+    void assign(std::vector<size_type>&& tasks) {
+        this->tasks = std::move(tasks);
+        this->range.store(pack(0, this->tasks.size()), std::memory_order_relaxed);
+    }
+
+    //owner takes from the front
+    bool pop(size_type& task) {
+        std::uint64_t r = this->range.load(std::memory_order_acquire);
+        while (head(r) < tail(r)) {
+            if (this->range.compare_exchange_weak(r, pack(head(r) + 1, tail(r)), std::memory_order_acq_rel)) {
+                task = this->tasks[head(r)];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //thieves take from the back
+    bool steal(size_type& task) {
+        std::uint64_t r = this->range.load(std::memory_order_acquire);
+        while (head(r) < tail(r)) {
+            if (this->range.compare_exchange_weak(r, pack(head(r), tail(r) - 1), std::memory_order_acq_rel)) {
+                task = this->tasks[tail(r) - 1];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    private:
+    std::vector<size_type> tasks;
+    std::atomic<std::uint64_t> range{0};
+
+    static std::uint64_t pack(std::uint64_t head, std::uint64_t tail) { return (head << 32) | tail; }
+    static std::uint64_t head(std::uint64_t r) { return r >> 32; }
+    static std::uint64_t tail(std::uint64_t r) { return r & 0xFFFFFFFFULL; }
+};
+
+//groups partition the query indices [0, n) into tasks with estimated cost[task], the queries of a task are run in group order
+//runs query(i, matches) for every i in [0, n) on threads OpenMP threads and calls deliver(i, matches) in order of i
+template<class Query, class Deliver>
+void batchQuery(gbwt::size_type n, const std::vector<std::vector<gbwt::size_type>>& groups, const std::vector<gbwt::size_type>& cost, gbwt::size_type threads, Query query, Deliver deliver) {
+    typedef gbwt::size_type size_type;
+    typedef std::vector<QueryEngine::match_type> result_type;
+    if (n == 0) { return; }
+    if (groups.size() >= (size_type(1) << 32)) { throw std::invalid_argument("batchQuery supports fewer than 2^32 tasks per batch"); }
+    if (threads == 0) { throw std::invalid_argument("batchQuery needs at least one thread"); }
+
+    //deal tasks in decreasing cost round robin over the threads
+    std::vector<size_type> order(groups.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&cost] (size_type a, size_type b) { return cost[a] > cost[b]; });
+    std::vector<BatchTaskDeque> deques(threads);
+    {
+        std::vector<std::vector<size_type>> dealt(threads);
+        for (size_type i = 0; i < order.size(); ++i)
+            dealt[i % threads].push_back(order[i]);
+        for (size_type t = 0; t < threads; ++t)
+            deques[t].assign(std::move(dealt[t]));
+    }
+
+    //in order delivery
+    std::vector<result_type> results(n);
+    std::unique_ptr<std::atomic<bool>[]> ready(new std::atomic<bool>[n]);
+    for (size_type i = 0; i < n; ++i) { ready[i].store(false, std::memory_order_relaxed); }
+    std::atomic<size_type> nextToDeliver{0};
+    std::atomic_flag delivering = ATOMIC_FLAG_INIT;
+    //a worker marks its query ready before trying the flag, and the deliverer clears the flag before checking the next query again,
+    //so a query made ready while another thread held the flag is seen by one of them. Both are sequentially consistent for this reason
+    auto tryDrain = [&] () {
+        while (!delivering.test_and_set()) {
+            size_type next = nextToDeliver.load(std::memory_order_relaxed);
+            while (next < n && ready[next].load(std::memory_order_acquire)) {
+                deliver(next, static_cast<const result_type&>(results[next]));
+                result_type().swap(results[next]);
+                nextToDeliver.store(++next, std::memory_order_relaxed);
+            }
+            delivering.clear();
+            next = nextToDeliver.load();
+            if (next >= n || !ready[next].load()) { break; }
+        }
+    };
+
+    #pragma omp parallel num_threads(threads)
+    {
+        size_type self = omp_get_thread_num(), task;
+        while (true) {
+            bool found = deques[self].pop(task);
+            for (size_type t = 1; !found && t < threads; ++t)
+                found = deques[(self + t) % threads].steal(task);
+            if (!found) { break; }
+            for (size_type i : groups[task]) {
+                query(i, results[i]);
+                ready[i].store(true);
+                tryDrain();
+            }
+        }
+    }
+    //every query is ready, deliver whatever the last drain did not reach
+    tryDrain();
+    assert(nextToDeliver == n);
+}
+
+//splits queries into tasks for batchQuery, one query per task if groupSize <= 1,
+//otherwise groupSize consecutive queries in lexicographic order per task, the cost of a task is its total query length
+void batchGroups(const std::vector<gbwt::vector_type>& queries, gbwt::size_type groupSize, std::vector<std::vector<gbwt::size_type>>& groups, std::vector<gbwt::size_type>& cost) {
+    std::vector<gbwt::size_type> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (groupSize <= 1) { groupSize = 1; }
+    else { std::sort(order.begin(), order.end(), [&queries] (gbwt::size_type a, gbwt::size_type b) { return queries[a] < queries[b]; }); }
+    groups.clear();
+    cost.clear();
+    for (gbwt::size_type i = 0; i < order.size(); ++i) {
+        if (i % groupSize == 0) {
+            groups.emplace_back();
+            cost.push_back(0);
+        }
+        groups.back().push_back(order[i]);
+        cost.back() += queries[order[i]].size();
+    }
+}
+
+//set maximal match queries of queries on engine, deliver(i, matches) is called in order of i
+template<class Deliver>
+void batchSetMaximalMatch(QueryEngine& engine, const std::vector<gbwt::vector_type>& queries, Deliver deliver, gbwt::size_type groupSize = 1) {
+    std::vector<std::vector<gbwt::size_type>> groups;
+    std::vector<gbwt::size_type> cost;
+    batchGroups(queries, groupSize, groups, cost);
+    gbwt::size_type threads = omp_get_max_threads();
+    engine.reserveThreads(threads);
+    batchQuery(queries.size(), groups, cost, threads, [&engine, &queries] (gbwt::size_type i, std::vector<QueryEngine::match_type>& matches) {
+            engine.setMaximalMatches(queries[i], matches);
+            }, deliver);
+}
+
+//long match queries with threshold L of queries on engine, deliver(i, matches) is called in order of i
+template<class Deliver>
+void batchLongMatch(QueryEngine& engine, const gbwt::size_type L, const std::vector<gbwt::vector_type>& queries, Deliver deliver, gbwt::size_type groupSize = 1) {
+    std::vector<std::vector<gbwt::size_type>> groups;
+    std::vector<gbwt::size_type> cost;
+    batchGroups(queries, groupSize, groups, cost);
+    gbwt::size_type threads = omp_get_max_threads();
+    engine.reserveThreads(threads);
+    batchQuery(queries.size(), groups, cost, threads, [&engine, &queries, L] (gbwt::size_type i, std::vector<QueryEngine::match_type>& matches) {
+            engine.longMatches(L, queries[i], matches);
+            }, deliver);
+}
+
+#endif //GBWT_QUERY_BATCHQUERY_H
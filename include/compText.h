@@ -120,6 +120,8 @@ class CompText{
     gbwt::node_type at(size_type) const;
     gbwt::node_type atFLsuff(size_type suff) const { return this->at(this->FLsuffToTrueSuff(suff)); }
     size_type textLength() const { return this->pathStarts.size(); }
+    //number of levels at() descends through, the cost of one access
+    size_type depth() const { return this->levels.size() + 1; }
 
     size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const {
         sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
@@ -53,6 +53,7 @@ SOFTWARE.
 
 //heavily derived/modified from FastLocate
 
+#include<algorithm>
 #include<gbwt/gbwt.h>
 #include<gbwt/fast_locate.h>
 #include<lf_gbwt.h>
@@ -68,6 +69,9 @@ struct FastLCP{
 
     sdsl::int_vector<0> samples_lcp;
 
+    //path_lengths[i] is the length of path i (excluding the endmarker)
+    sdsl::int_vector<0> path_lengths;
+
     FastLCP() = default;
     explicit FastLCP(const gbwt::FastLocate& source);
     explicit FastLCP(const lf_gbwt::GBWT&, const gbwt::FastLocate&);
@@ -80,9 +84,11 @@ struct FastLCP{
     size_type locatePrev(size_type next) const;
     size_type LCP(size_type suff) const;
 
+    gbwt::comp_type toComp(gbwt::node_type node) const { return this->rindex->index->toComp(node); }
+
     size_type globalRunId(gbwt::node_type node, size_type run_id) const
     {
-        return this->rindex->comp_to_run[this->rindex->index->toComp(node)] + run_id;
+        return this->rindex->comp_to_run[this->toComp(node)] + run_id;
     }
 
     size_type getSample(gbwt::node_type node, size_type run_id) const
@@ -104,14 +110,16 @@ struct FastLCP{
     }
 
     //returns path length not including endmarker
-    size_type pathLength(gbwt::size_type i) {
+    size_type pathLength(gbwt::size_type i) const {
+        if (this->path_lengths.size())
+            return (i < this->path_lengths.size())? size_type(this->path_lengths[i]) : gbwt::invalid_offset();
         if (i >= this->rindex->seqId(this->first.size()))
             return gbwt::invalid_offset();
         auto iter = this->first.predecessor(this->rindex->pack(i+1,0)-1);
-        return iter->second + this->samples_lcp[iter->first];
+        return this->rindex->seqOffset(iter->second + this->samples_lcp[iter->first]);
     }
 
-    std::vector<gbwt::size_type> decompressSA(const gbwt::node_type node) {
+    std::vector<gbwt::size_type> decompressSA(const gbwt::node_type node) const {
         if (!this->rindex->index->contains(node)) { return {}; }
         gbwt::size_type n = this->rindex->index->nodeSize(node);
         if (n == 0) { return {}; }
@@ -122,12 +130,85 @@ struct FastLCP{
         return rec;
     }
 
-    bool verifySuff() {
+    //calls report(offset, chunk) for consecutive chunks of the suffixes of node in BWT order
+    //chunk holds at most chunkSize suffixes, the first of which is at offset in node
+    //the chunk buffer is reused, so at most chunkSize suffixes are resident at a time
+    template<class Report>
+    void decompressSA(const gbwt::node_type node, const size_type chunkSize, Report report) const {
+        if (!this->rindex->index->contains(node) || chunkSize == 0) { return; }
+        gbwt::size_type n = this->rindex->index->nodeSize(node);
+        if (n == 0) { return; }
+        std::vector<gbwt::size_type> chunk;
+        chunk.reserve(std::min(n, chunkSize));
+        gbwt::size_type suff = this->rindex->locateFirst(node);
+        for (gbwt::size_type i = 0; i < n; ++i) {
+            if (i != 0) { suff = this->rindex->locateNext(suff); }
+            chunk.push_back(suff);
+            if (chunk.size() == chunkSize || i + 1 == n) {
+                report(i + 1 - chunk.size(), static_cast<const std::vector<gbwt::size_type>&>(chunk));
+                chunk.clear();
+            }
+        }
+    }
+
+    //last offset of each logical run of node, runs of the endmarker are split into runs of length 1
+    //runEnds[i] belongs to the run with run_id i, see getSample
+    std::vector<gbwt::size_type> logicalRunEnds(const gbwt::node_type node) const {
+        std::vector<gbwt::size_type> runEnds;
+        gbwt::CompressedRecord rec = this->rindex->index->record(node);
+        for (gbwt::CompressedRecordIterator iter(rec); !iter.end(); ++iter) {
+            if (rec.outgoing[iter->first].first == gbwt::ENDMARKER) {
+                for (gbwt::size_type i = iter.offset() - iter->second; i < iter.offset(); ++i) { runEnds.push_back(i); }
+            }
+            else { runEnds.push_back(iter.offset() - 1); }
+        }
+        return runEnds;
+    }
+
+    //decompresses the suffixes of node with one locatePrev chain per logical run
+    //each chain starts at the bottom sample of its run, chains are run in parallel
+    std::vector<gbwt::size_type> decompressSAParallel(const gbwt::node_type node) const {
+        if (!this->rindex->index->contains(node)) { return {}; }
+        gbwt::size_type n = this->rindex->index->nodeSize(node);
+        if (n == 0) { return {}; }
+
+        std::vector<gbwt::size_type> runEnds = this->logicalRunEnds(node);
+        assert(runEnds.size() && runEnds.back() == n - 1);
+
+        std::vector<gbwt::size_type> sa(n);
+        sa.shrink_to_fit();
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (gbwt::size_type run = 0; run < runEnds.size(); ++run) {
+            gbwt::size_type start = (run == 0)? 0 : runEnds[run-1] + 1;
+            sa[runEnds[run]] = this->getSampleBot(node, run);
+            for (gbwt::size_type i = runEnds[run]; i != start; --i) { sa[i-1] = this->locatePrev(sa[i]); }
+        }
+        return sa;
+    }
+
+    //compares the path length table to the lengths found by locating each endmarker
+    bool verifyPathLengths() const {
+        if (this->path_lengths.size() != this->rindex->index->sequences()) { return false; }
+        bool good = true;
+        size_type suff = this->rindex->locateFirst(gbwt::ENDMARKER);
+        for (size_type i = 0; i < this->path_lengths.size(); ++i) {
+            //the endmarker record is sorted by sequence id
+            good = good && this->rindex->seqId(suff) == i && this->path_lengths[i] == this->rindex->seqOffset(suff);
+            if (i + 1 < this->path_lengths.size()) { suff = this->rindex->locateNext(suff); }
+        }
+        return good;
+    }
+
+    bool verifySuff() const {
         bool good = true;
         #pragma omp parallel for schedule(dynamic, 1)
         for (gbwt::comp_type i = 0; i < this->rindex->index->effective(); ++i) {
-            gbwt::size_type node = this->rindex->index->effective();
-            bool thisNodeGood = (this->decompressSA(node) == this->rindex->decompressSA(node));
+            gbwt::node_type node = this->rindex->index->toNode(i);
+            std::vector<gbwt::size_type> truth = this->rindex->decompressSA(node);
+            bool thisNodeGood = (this->decompressSA(node) == truth) && (this->decompressSAParallel(node) == truth);
+            this->decompressSA(node, 3, [&truth, &thisNodeGood] (gbwt::size_type offset, const std::vector<gbwt::size_type>& chunk) {
+                    thisNodeGood = thisNodeGood && std::equal(chunk.begin(), chunk.end(), truth.begin() + offset);
+                    });
             #pragma omp critical 
             {
                 good = good && thisNodeGood;
@@ -205,6 +286,7 @@ FastLCP::FastLCP(const gbwt::FastLocate& source) : rindex(&source) {
 
     // Extract the samples from each sequence.
     double extract_start = readTimer();
+    std::vector<size_type> lengths(this->rindex->index->sequences(), 0);
    if(Verbosity::level >= Verbosity::FULL)
     {
         std::cerr << msgPrefix << "Extracting head/tail samples" << std::endl;
@@ -238,6 +320,7 @@ FastLCP::FastLCP(const gbwt::FastLocate& source) : rindex(&source) {
             }
             curr = next; seq_offset++;
         }
+        lengths[i] = seq_offset - 1;
         // GBWT is an FM-index of the reverse paths. The sequence offset r-index needs
         // is the distance to the BWT position with the endmarker (to the end of the
         // path, to the start of the string).
@@ -251,6 +334,13 @@ FastLCP::FastLCP(const gbwt::FastLocate& source) : rindex(&source) {
         }
     }
     sdsl::util::clear(endmarker_runs);
+    this->path_lengths.resize(lengths.size());
+    for(size_type i = 0; i < lengths.size(); i++)
+    {
+        this->path_lengths[i] = lengths[i];
+    }
+    sdsl::util::bit_compress(this->path_lengths);
+    sdsl::util::clear(lengths);
     if(Verbosity::level >= Verbosity::BASIC)
     {
         double seconds = readTimer() - extract_start;
@@ -416,6 +506,7 @@ FastLCP::FastLCP(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r) : rindex(&
 
     // Extract the samples from each sequence.
     double extract_start = readTimer();
+    std::vector<size_type> lengths(lfg.sequences(), 0);
     if(Verbosity::level >= Verbosity::FULL)
     {
         std::cerr << msgPrefix << "Extracting head/tail samples" << std::endl;
@@ -449,6 +540,7 @@ FastLCP::FastLCP(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r) : rindex(&
             }
             curr = next; seq_offset++;
         }
+        lengths[i] = seq_offset - 1;
         // GBWT is an FM-index of the reverse paths. The sequence offset r-index needs
         // is the distance to the BWT position with the endmarker (to the end of the
         // path, to the start of the string).
@@ -462,6 +554,13 @@ FastLCP::FastLCP(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r) : rindex(&
         }
     }
     sdsl::util::clear(endmarker_runs);
+    this->path_lengths.resize(lengths.size());
+    for(size_type i = 0; i < lengths.size(); i++)
+    {
+        this->path_lengths[i] = lengths[i];
+    }
+    sdsl::util::bit_compress(this->path_lengths);
+    sdsl::util::clear(lengths);
     if(Verbosity::level >= Verbosity::BASIC)
     {
         double seconds = readTimer() - extract_start;
@@ -578,6 +677,7 @@ FastLCP::size_type FastLCP::serialize(std::ostream &out, sdsl::structure_tree_no
     written_bytes += sdsl::serialize(this->first, out, child, "first");
     written_bytes += sdsl::serialize(this->first_to_run, out, child, "first_to_run");
     written_bytes += sdsl::serialize(this->samples_lcp, out, child, "samples_lcp");
+    written_bytes += sdsl::serialize(this->path_lengths, out, child, "path_lengths");
 
     sdsl::structure_tree::add_size(child, written_bytes);
     return written_bytes;
@@ -588,6 +688,7 @@ void FastLCP::load(std::istream& in) {
     sdsl::load(this->first, in);
     sdsl::load(this->first_to_run, in);
     sdsl::load(this->samples_lcp, in);
+    sdsl::load(this->path_lengths, in);
 }
 
 const std::string FastLCP::EXTENSION = ".flcp";
@@ -0,0 +1,259 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_FAST_RLCP_H
+#define GBWT_QUERY_FAST_RLCP_H
+
+#include"fast_lcp.h"
+#include<gbwt/fast_locate.h>
+
+//FastRLCP stores the samples of gbwt::FastLocate and FastLCP in one structure
+//The run directory (comp_to_run) is stored once and the top, bottom, and lcp samples 
+//of a logical run are stored next to each other in runs, so locateNext, locatePrev and LCP
+//on the same run touch the same cache line
+//FastRLCP does not need the GBWT or FastLocate after construction, it has the accessors of both that virtual insertion
+//and locating matches use, so setMaximalMatchQuery3 runs on it alone in place of the FastLocate and FastLCP
+struct FastRLCP{
+    typedef gbwt::size_type size_type;
+
+    //FastLocate header values needed to pack and unpack suffixes
+    size_type max_length = 0;
+    //GBWT header offset, for mapping nodes to records
+    size_type offset = 0;
+
+    //width of the top/bottom samples and of the lcp samples in runs
+    size_type sample_width = 0;
+    size_type lcp_width = 0;
+
+    //the record of logical run i is stored at bits [i*recordWidth(), (i+1)*recordWidth()) of runs
+    //as top sample, bottom sample, lcp sample of the head of run i
+    sdsl::bit_vector runs;
+    size_type total_runs = 0;
+
+    //shared run directory, comp_to_run[c] is the first logical run of record c
+    sdsl::int_vector<0> comp_to_run;
+
+    //tails of runs in text order (FastLocate::last) and their runs
+    sdsl::sd_vector<> last;
+    sdsl::int_vector<0> last_to_run;
+
+    //heads of runs in text order (FastLCP::first) and their runs
+    sdsl::sd_vector<> first;
+    sdsl::int_vector<0> first_to_run;
+
+    //path_lengths[i] is the length of path i (excluding the endmarker)
+    sdsl::int_vector<0> path_lengths;
+
+    FastRLCP() = default;
+    //l.rindex must be set
+    explicit FastRLCP(const FastLCP& l);
+
+    size_type serialize(std::ostream &out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
+    void load(std::istream& in);
+
+    const static std::string EXTENSION; //.frlcp
+
+    size_type recordWidth() const { return 2*this->sample_width + this->lcp_width; }
+    size_type size() const { return this->total_runs; }
+    bool empty() const { return this->total_runs == 0; }
+
+    size_type pack(size_type sequence_id, size_type sequence_offset) const { return sequence_id * this->max_length + sequence_offset; }
+    size_type seqId(size_type offset) const { return offset / this->max_length; }
+    size_type seqOffset(size_type offset) const { return offset % this->max_length; }
+    std::pair<size_type, size_type> unpack(size_type offset) const { return std::make_pair(this->seqId(offset), this->seqOffset(offset)); }
+
+    gbwt::comp_type toComp(gbwt::node_type node) const { return (node == gbwt::ENDMARKER)? node : node - this->offset; }
+
+    size_type globalRunId(gbwt::node_type node, size_type run_id) const
+    {
+        return this->comp_to_run[this->toComp(node)] + run_id;
+    }
+
+    size_type runTop(size_type run) const { return this->runs.get_int(run*this->recordWidth(), this->sample_width); }
+    size_type runBot(size_type run) const { return this->runs.get_int(run*this->recordWidth() + this->sample_width, this->sample_width); }
+    size_type runLCP(size_type run) const { return this->runs.get_int(run*this->recordWidth() + 2*this->sample_width, this->lcp_width); }
+
+    size_type getSample(gbwt::node_type node, size_type run_id) const { return this->runTop(this->globalRunId(node, run_id)); }
+    size_type getSampleBot(gbwt::node_type node, size_type run_id) const { return this->runBot(this->globalRunId(node, run_id)); }
+
+    size_type locateFirst(gbwt::node_type node) const { return this->runTop(this->comp_to_run[this->toComp(node)]); }
+    size_type locateLast(gbwt::node_type node) const
+    {
+        size_type comp = this->toComp(node);
+        size_type runId = (comp+1 == this->comp_to_run.size())? this->total_runs-1 : this->comp_to_run[comp+1] - 1;
+        return this->runBot(runId);
+    }
+
+    size_type locateNext(size_type prev) const;
+    size_type locatePrev(size_type next) const;
+    size_type LCP(size_type suff) const;
+    //locatePrev(next) and LCP(next) with one predecessor query
+    std::pair<size_type, size_type> locatePrevLCP(size_type next) const;
+
+    //returns path length not including endmarker
+    size_type pathLength(gbwt::size_type i) const {
+        return (i < this->path_lengths.size())? size_type(this->path_lengths[i]) : gbwt::invalid_offset();
+    }
+
+    //checks every sample against the FastLocate and FastLCP the structure was built from
+    bool verify(const FastLCP& l) const;
+};
+
+FastRLCP::size_type FastRLCP::locateNext(size_type prev) const {
+    auto iter = this->last.predecessor(prev);
+    return this->runTop(this->last_to_run[iter->first] + 1) + (prev - iter->second);
+}
+
+FastRLCP::size_type FastRLCP::locatePrev(size_type next) const {
+    auto iter = this->first.predecessor(next);
+    return this->runBot(this->first_to_run[iter->first] - 1) + (next - iter->second);
+}
+
+FastRLCP::size_type FastRLCP::LCP(size_type suff) const {
+    auto iter = this->first.predecessor(suff);
+    return this->runLCP(this->first_to_run[iter->first]) - (suff - iter->second);
+}
+
+std::pair<FastRLCP::size_type, FastRLCP::size_type> FastRLCP::locatePrevLCP(size_type next) const {
+    auto iter = this->first.predecessor(next);
+    size_type run = this->first_to_run[iter->first], dist = next - iter->second;
+    return std::make_pair(this->runBot(run - 1) + dist, this->runLCP(run) - dist);
+}
+
+FastRLCP::FastRLCP(const FastLCP& l) {
+    using namespace gbwt;
+    double start = readTimer();
+    const char msgPrefix[] = "FastRLCP::FastRLCP(FastLCP): ";
+    const FastLocate& r = *l.rindex;
+
+    if (r.empty())
+    {
+        if(Verbosity::level >= Verbosity::FULL)
+        {
+            std::cerr << msgPrefix << "The input FastLocate data structure is empty" << std::endl;
+        }
+        return;
+    }
+
+    this->max_length = r.header.max_length;
+    this->offset = r.index->header.offset;
+    this->total_runs = r.samples.size();
+
+    this->sample_width = std::max(r.samples.width(), l.samples_bot.width());
+    this->lcp_width = std::max<size_type>(l.samples_lcp.width(), 1);
+    this->runs = sdsl::bit_vector(this->total_runs * this->recordWidth(), 0);
+
+    // Records share words of runs, so they are written sequentially.
+    // The lcp samples of FastLCP are stored by rank in first, store them by run.
+    for (size_type i = 0; i < this->total_runs; ++i)
+    {
+        this->runs.set_int(i*this->recordWidth(), r.samples[i], this->sample_width);
+        this->runs.set_int(i*this->recordWidth() + this->sample_width, l.samples_bot[i], this->sample_width);
+        this->runs.set_int(l.first_to_run[i]*this->recordWidth() + 2*this->sample_width, l.samples_lcp[i], this->lcp_width);
+    }
+
+    this->comp_to_run = r.comp_to_run;
+    this->last = r.last;
+    this->last_to_run = r.last_to_run;
+    this->first = l.first;
+    this->first_to_run = l.first_to_run;
+    this->path_lengths = l.path_lengths;
+
+    if(Verbosity::level >= Verbosity::BASIC)
+    {
+        double seconds = readTimer() - start;
+        std::cerr << msgPrefix << "Interleaved " << this->total_runs << " runs in " << seconds << " seconds" << std::endl;
+    }
+}
+
+bool FastRLCP::verify(const FastLCP& l) const {
+    const gbwt::FastLocate& r = *l.rindex;
+    if (this->total_runs != r.samples.size() || this->comp_to_run.size() != r.comp_to_run.size() 
+            || this->path_lengths.size() != l.path_lengths.size())
+        return false;
+    if (this->total_runs && (this->max_length != r.header.max_length || this->offset != r.index->header.offset))
+        return false;
+    bool good = true;
+    #pragma omp parallel for schedule(static)
+    for (size_type i = 0; i < this->total_runs; ++i) {
+        bool thisGood = this->runTop(i) == r.samples[i] && this->runBot(i) == l.samples_bot[i]
+            && this->runLCP(l.first_to_run[i]) == l.samples_lcp[i]
+            && this->first_to_run[i] == l.first_to_run[i] && this->last_to_run[i] == r.last_to_run[i];
+        #pragma omp critical
+        {
+            good = good && thisGood;
+        }
+    }
+    for (size_type i = 0; good && i < this->comp_to_run.size(); ++i)
+        good = this->comp_to_run[i] == r.comp_to_run[i];
+    for (size_type i = 0; good && i < this->path_lengths.size(); ++i)
+        good = this->path_lengths[i] == l.path_lengths[i];
+    for (size_type i = 0; good && i < this->total_runs; ++i) {
+        good = this->first.select_iter(i+1)->second == l.first.select_iter(i+1)->second
+            && this->last.select_iter(i+1)->second == r.last.select_iter(i+1)->second;
+    }
+    return good;
+}
+
+FastRLCP::size_type FastRLCP::serialize(std::ostream &out, sdsl::structure_tree_node* v, std::string name) const {
+    sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+    size_type written_bytes = 0;
+
+    written_bytes += sdsl::serialize(this->max_length, out, child, "max_length");
+    written_bytes += sdsl::serialize(this->offset, out, child, "offset");
+    written_bytes += sdsl::serialize(this->sample_width, out, child, "sample_width");
+    written_bytes += sdsl::serialize(this->lcp_width, out, child, "lcp_width");
+    written_bytes += sdsl::serialize(this->total_runs, out, child, "total_runs");
+    written_bytes += sdsl::serialize(this->runs, out, child, "runs");
+    written_bytes += sdsl::serialize(this->comp_to_run, out, child, "comp_to_run");
+    written_bytes += sdsl::serialize(this->last, out, child, "last");
+    written_bytes += sdsl::serialize(this->last_to_run, out, child, "last_to_run");
+    written_bytes += sdsl::serialize(this->first, out, child, "first");
+    written_bytes += sdsl::serialize(this->first_to_run, out, child, "first_to_run");
+    written_bytes += sdsl::serialize(this->path_lengths, out, child, "path_lengths");
+
+    sdsl::structure_tree::add_size(child, written_bytes);
+    return written_bytes;
+}
+
+void FastRLCP::load(std::istream& in) {
+    sdsl::load(this->max_length, in);
+    sdsl::load(this->offset, in);
+    sdsl::load(this->sample_width, in);
+    sdsl::load(this->lcp_width, in);
+    sdsl::load(this->total_runs, in);
+    sdsl::load(this->runs, in);
+    sdsl::load(this->comp_to_run, in);
+    sdsl::load(this->last, in);
+    sdsl::load(this->last_to_run, in);
+    sdsl::load(this->first, in);
+    sdsl::load(this->first_to_run, in);
+    sdsl::load(this->path_lengths, in);
+}
+
+const std::string FastRLCP::EXTENSION = ".frlcp";
+//------------------------------------------------------------------------------
+
+#endif //GBWT_QUERY_FAST_RLCP_H
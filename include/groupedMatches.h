@@ -0,0 +1,177 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_GROUPED_MATCHES_H
+#define GBWT_QUERY_GROUPED_MATCHES_H
+
+#include<gbwt/gbwt.h>
+#include<vector>
+#include<tuple>
+#include<utility>
+#include<algorithm>
+
+//GroupedMatches holds matches as groups that share (start in Q, length), each with one (path, start in path) entry per
+//matching path, instead of one tuple per path. It is a callable sink (see emitMatch), so the query functions taking a
+//Sink fill it directly. A match extends the last group if it has the same (start, length); the queries emit the paths
+//of one match consecutively, so there is usually one group per match, but a match may be split over several groups
+struct GroupedMatches{
+    typedef gbwt::size_type size_type;
+    typedef std::tuple<size_type,size_type,size_type,size_type> match_type;
+
+    //(start in Q, length) of each group
+    std::vector<std::pair<size_type,size_type>> headers;
+    //the entries of group g are [groupStarts[g], groupStarts[g+1])
+    std::vector<size_type> groupStarts = {0};
+    std::vector<size_type> paths, pathStarts;
+
+    void operator()(size_type start, size_type len, size_type path, size_type pathStart) {
+        if (this->headers.empty() || this->headers.back() != std::make_pair(start, len)) {
+            this->headers.emplace_back(start, len);
+            this->groupStarts.push_back(this->paths.size());
+        }
+        this->paths.push_back(path);
+        this->pathStarts.push_back(pathStart);
+        ++this->groupStarts.back();
+    }
+
+    size_type groups() const { return this->headers.size(); }
+    //number of matches (entries)
+    size_type size() const { return this->paths.size(); }
+    void clear() { this->headers.clear(); this->groupStarts = {0}; this->paths.clear(); this->pathStarts.clear(); }
+
+    //one (start in Q, length, path ID, start position in path) tuple per entry, in the order of the groups
+    std::vector<match_type> expand() const {
+        std::vector<match_type> matches;
+        matches.reserve(this->size());
+        for (size_type g = 0; g < this->groups(); ++g)
+            for (size_type i = this->groupStarts[g]; i < this->groupStarts[g+1]; ++i)
+                matches.emplace_back(this->headers[g].first, this->headers[g].second, this->paths[i], this->pathStarts[i]);
+        return matches;
+    }
+};
+
+//GroupedMatches with every field bit-compressed for storage and serialization. With delta, the entries of each group
+//are sorted by path and paths holds the difference to the previous path of the group (0 for the first one, which is
+//kept in firstPaths), so the width of paths depends on how dense the matching haplotypes are rather than on their ids
+struct PackedGroupedMatches{
+    typedef gbwt::size_type size_type;
+    typedef GroupedMatches::match_type match_type;
+
+    bool delta = false;
+    sdsl::int_vector<0> starts, lengths, groupStarts, firstPaths, paths, pathStarts;
+
+    PackedGroupedMatches() = default;
+    explicit PackedGroupedMatches(const GroupedMatches& matches, bool delta = false);
+
+    size_type groups() const { return this->starts.size(); }
+    size_type size() const { return this->paths.size(); }
+    std::vector<match_type> expand() const;
+    //same matches as matches, in any order
+    bool verify(const GroupedMatches& matches) const;
+
+    size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, std::string name = "") const;
+    void load(std::istream& in);
+};
+
+PackedGroupedMatches::PackedGroupedMatches(const GroupedMatches& matches, bool delta) : delta(delta) {
+    size_type groups = matches.groups(), entries = matches.size();
+    this->starts = sdsl::int_vector<0>(groups);
+    this->lengths = sdsl::int_vector<0>(groups);
+    this->groupStarts = sdsl::int_vector<0>(groups + 1);
+    this->firstPaths = sdsl::int_vector<0>((delta)? groups : 0);
+    this->paths = sdsl::int_vector<0>(entries);
+    this->pathStarts = sdsl::int_vector<0>(entries);
+    std::vector<std::pair<size_type,size_type>> entriesOfGroup;
+    for (size_type g = 0; g < groups; ++g) {
+        this->starts[g] = matches.headers[g].first;
+        this->lengths[g] = matches.headers[g].second;
+        this->groupStarts[g] = matches.groupStarts[g];
+        entriesOfGroup.clear();
+        for (size_type i = matches.groupStarts[g]; i < matches.groupStarts[g+1]; ++i)
+            entriesOfGroup.emplace_back(matches.paths[i], matches.pathStarts[i]);
+        if (delta) {
+            std::sort(entriesOfGroup.begin(), entriesOfGroup.end());
+            this->firstPaths[g] = entriesOfGroup.front().first;
+        }
+        for (size_type i = 0, prev = (delta)? entriesOfGroup.front().first : 0; i < entriesOfGroup.size(); ++i) {
+            this->paths[matches.groupStarts[g] + i] = entriesOfGroup[i].first - prev;
+            this->pathStarts[matches.groupStarts[g] + i] = entriesOfGroup[i].second;
+            if (delta) { prev = entriesOfGroup[i].first; }
+        }
+    }
+    this->groupStarts[groups] = entries;
+    sdsl::util::bit_compress(this->starts);
+    sdsl::util::bit_compress(this->lengths);
+    sdsl::util::bit_compress(this->groupStarts);
+    sdsl::util::bit_compress(this->firstPaths);
+    sdsl::util::bit_compress(this->paths);
+    sdsl::util::bit_compress(this->pathStarts);
+}
+
+std::vector<PackedGroupedMatches::match_type> PackedGroupedMatches::expand() const {
+    std::vector<match_type> matches;
+    matches.reserve(this->size());
+    for (size_type g = 0; g < this->groups(); ++g) {
+        size_type path = (this->delta)? this->firstPaths[g] : 0;
+        for (size_type i = this->groupStarts[g]; i < this->groupStarts[g+1]; ++i) {
+            path = (this->delta)? path + this->paths[i] : this->paths[i];
+            matches.emplace_back(this->starts[g], this->lengths[g], path, this->pathStarts[i]);
+        }
+    }
+    return matches;
+}
+
+bool PackedGroupedMatches::verify(const GroupedMatches& matches) const {
+    std::vector<match_type> packed = this->expand(), expected = matches.expand();
+    std::sort(packed.begin(), packed.end());
+    std::sort(expected.begin(), expected.end());
+    return this->groups() == matches.groups() && packed == expected;
+}
+
+PackedGroupedMatches::size_type PackedGroupedMatches::serialize(std::ostream& out, sdsl::structure_tree_node* v, std::string name) const {
+    sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+    size_type bytes = 0;
+    bytes += sdsl::serialize(this->delta, out, child, "delta");
+    bytes += sdsl::serialize(this->starts, out, child, "starts");
+    bytes += sdsl::serialize(this->lengths, out, child, "lengths");
+    bytes += sdsl::serialize(this->groupStarts, out, child, "groupStarts");
+    bytes += sdsl::serialize(this->firstPaths, out, child, "firstPaths");
+    bytes += sdsl::serialize(this->paths, out, child, "paths");
+    bytes += sdsl::serialize(this->pathStarts, out, child, "pathStarts");
+    sdsl::structure_tree::add_size(child, bytes);
+    return bytes;
+}
+
+void PackedGroupedMatches::load(std::istream& in) {
+    sdsl::load(this->delta, in);
+    sdsl::load(this->starts, in);
+    sdsl::load(this->lengths, in);
+    sdsl::load(this->groupStarts, in);
+    sdsl::load(this->firstPaths, in);
+    sdsl::load(this->paths, in);
+    sdsl::load(this->pathStarts, in);
+}
+
+#endif //GBWT_QUERY_GROUPED_MATCHES_H
@@ -0,0 +1,167 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_HAPLOTYPE_FILTER_H
+#define GBWT_QUERY_HAPLOTYPE_FILTER_H
+
+#include"fast_lcp.h"
+#include<vector>
+#include<string>
+#include<stdexcept>
+
+//HaplotypeFilter is a subset of the sequences (haplotypes) of the GBWT that matches are reported for, see FilteredSink
+//besides one bit per sequence it keeps one bit per logical run and per node of the r-index telling whether any suffix
+//of the run or node belongs to a member, so match reporting can skip nodes without members without locating them
+//building the summaries decompresses every node once and needs the full GBWT behind l
+struct HaplotypeFilter{
+    typedef gbwt::size_type size_type;
+
+    //members[i] is set if sequence i is reported
+    sdsl::bit_vector members;
+    //runs[l.globalRunId(node, run_id)] is set if a suffix of the run is a member
+    sdsl::bit_vector runs;
+    //nodes[comp] is set if a suffix of the node is a member
+    sdsl::bit_vector nodes;
+
+    HaplotypeFilter() = default;
+    //sequences are sequence ids, the orientations of a path in a bidirectional GBWT are distinct sequences
+    HaplotypeFilter(const FastLCP& l, const std::vector<size_type>& sequences);
+    //both orientations of every path of the named samples, resolved through metadata
+    HaplotypeFilter(const FastLCP& l, const gbwt::Metadata& metadata, const std::vector<std::string>& samples);
+
+    //Samples is the FastLCP the filter was built on or a FastRLCP of it, both number runs and nodes the same way
+    bool contains(size_type sequence) const { return sequence < this->members.size() && this->members[sequence]; }
+    template<class Samples>
+    bool runHasMembers(const Samples& l, gbwt::node_type node, size_type run_id) const { return this->runs[l.globalRunId(node, run_id)]; }
+    template<class Samples>
+    bool runsHaveMembers(const Samples& l, gbwt::node_type node, size_type firstRun, size_type lastRun) const {
+        for (size_type run = firstRun; run <= lastRun; ++run)
+            if (this->runHasMembers(l, node, run)) { return true; }
+        return false;
+    }
+    template<class Samples>
+    bool nodeHasMembers(const Samples& l, gbwt::node_type node) const { return this->nodes[l.toComp(node)]; }
+
+    bool verify(const FastLCP& l) const;
+
+    private:
+    void build(const FastLCP& l, const std::vector<size_type>& sequences);
+};
+
+HaplotypeFilter::HaplotypeFilter(const FastLCP& l, const std::vector<size_type>& sequences) {
+    this->build(l, sequences);
+}
+
+HaplotypeFilter::HaplotypeFilter(const FastLCP& l, const gbwt::Metadata& metadata, const std::vector<std::string>& samples) {
+    if (!metadata.hasSampleNames() || !metadata.hasPathNames()) { throw std::invalid_argument("HaplotypeFilter: metadata must have sample and path names!"); }
+    std::vector<size_type> sequences;
+    for (const std::string& name : samples) {
+        size_type sample = metadata.sample(name);
+        if (sample >= metadata.samples()) { throw std::invalid_argument("HaplotypeFilter: unknown sample " + name + "!"); }
+        for (size_type path : metadata.pathsForSample(sample)) {
+            sequences.push_back(gbwt::Path::encode(path, false));
+            if (l.rindex->index->bidirectional()) { sequences.push_back(gbwt::Path::encode(path, true)); }
+        }
+    }
+    this->build(l, sequences);
+}
+
+//every sequence except the excluded ones, for answering queries as if the excluded sequences were not in the index
+//(leave-one-out), see setMaximalMatchQueryExcludingT. It is only a bit vector of the excluded sequences, without the run
+//and node summaries of HaplotypeFilter (every run and node may have members), so it is built without decompressing any
+//node or loading the GBWT, and a new exclusion set costs one bit per sequence. It is a filter of FilteredSink and a
+//Remaining of leaveOutLcps
+struct ExcludedSequences{
+    typedef gbwt::size_type size_type;
+
+    //excluded[i] is set if sequence i is left out
+    sdsl::bit_vector excluded;
+
+    bool contains(size_type sequence) const { return sequence < this->excluded.size() && !this->excluded[sequence]; }
+    template<class Samples> bool runHasMembers(const Samples&, gbwt::node_type, size_type) const { return true; }
+    template<class Samples> bool runsHaveMembers(const Samples&, gbwt::node_type, size_type, size_type) const { return true; }
+    template<class Samples> bool nodeHasMembers(const Samples&, gbwt::node_type) const { return true; }
+};
+
+//sequences is the number of sequences of the index
+ExcludedSequences excludingSequences(const gbwt::size_type sequences, const std::vector<gbwt::size_type>& excluded) {
+    ExcludedSequences remaining{sdsl::bit_vector(sequences, 0)};
+    for (gbwt::size_type sequence : excluded) {
+        if (sequence >= sequences) { throw std::invalid_argument("excludingSequences: sequence id out of range!"); }
+        remaining.excluded[sequence] = 1;
+    }
+    return remaining;
+}
+
+void HaplotypeFilter::build(const FastLCP& l, const std::vector<size_type>& sequences) {
+    const gbwt::GBWT& g = *l.rindex->index;
+    this->members = sdsl::bit_vector(g.sequences(), 0);
+    for (size_type sequence : sequences) {
+        if (sequence >= g.sequences()) { throw std::invalid_argument("HaplotypeFilter: sequence id out of range!"); }
+        this->members[sequence] = 1;
+    }
+    this->runs = sdsl::bit_vector(l.samples_bot.size(), 0);
+    this->nodes = sdsl::bit_vector(g.effective(), 0);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (gbwt::comp_type comp = 0; comp < g.effective(); ++comp) {
+        gbwt::node_type node = g.toNode(comp);
+        if (g.nodeSize(node) == 0) { continue; }
+        std::vector<size_type> sa = l.decompressSA(node), runEnds = l.logicalRunEnds(node), withMembers;
+        for (size_type run = 0, i = 0; run < runEnds.size(); ++run) {
+            bool runHas = false;
+            for (; i <= runEnds[run]; ++i) { runHas = runHas || this->contains(l.rindex->seqId(sa[i])); }
+            if (runHas) { withMembers.push_back(run); }
+        }
+        #pragma omp critical
+        {
+            for (size_type run : withMembers) { this->runs[l.globalRunId(node, run)] = 1; }
+            this->nodes[comp] = !withMembers.empty();
+        }
+    }
+}
+
+//compares the summaries to the members of every suffix
+bool HaplotypeFilter::verify(const FastLCP& l) const {
+    const gbwt::GBWT& g = *l.rindex->index;
+    if (this->members.size() != g.sequences() || this->runs.size() != l.samples_bot.size() || this->nodes.size() != g.effective()) { return false; }
+    bool good = true;
+    for (gbwt::comp_type comp = 0; comp < g.effective() && good; ++comp) {
+        gbwt::node_type node = g.toNode(comp);
+        std::vector<size_type> sa = l.rindex->decompressSA(node), runEnds;
+        if (sa.size()) { runEnds = l.logicalRunEnds(node); }
+        bool nodeHas = false;
+        for (size_type run = 0, i = 0; run < runEnds.size(); ++run) {
+            bool runHas = false;
+            for (; i <= runEnds[run]; ++i) { runHas = runHas || this->contains(l.rindex->seqId(sa[i])); }
+            good = good && this->runHasMembers(l, node, run) == runHas;
+            nodeHas = nodeHas || runHas;
+        }
+        good = good && this->nodes[comp] == nodeHas;
+    }
+    return good;
+}
+
+#endif //GBWT_QUERY_HAPLOTYPE_FILTER_H
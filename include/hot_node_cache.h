@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_HOT_NODE_CACHE_H
+#define GBWT_QUERY_HOT_NODE_CACHE_H
+
+#include"fast_lcp.h"
+#include<vector>
+#include<algorithm>
+
+//HotNodeCache stores the suffix array and LCP array of a small set of nodes explicitly
+//so that match reporting and long match block expansion on those nodes are array scans
+//instead of locateNext/locatePrev/LCP queries
+//nodes are selected by size or by an access profile, up to a memory cap
+struct HotNodeCache{
+    typedef gbwt::size_type size_type;
+
+    //cached nodes in increasing order
+    std::vector<gbwt::node_type> nodes;
+    //the arrays of nodes[i] are at [starts[i], starts[i+1]) of sa and lcp
+    std::vector<size_type> starts;
+    //sa[starts[i]+j] is the suffix at offset j of nodes[i]
+    std::vector<size_type> sa;
+    //lcp[starts[i]+j] is FastLCP::LCP(sa[starts[i]+j])
+    std::vector<size_type> lcp;
+
+    HotNodeCache() : starts(1, 0) {}
+    //caches every node with at least minNodeSize suffixes, largest first, while the arrays fit in maxBytes
+    HotNodeCache(const FastLCP& l, size_type minNodeSize, size_type maxBytes);
+    //caches the nodes of profile, (node, number of accesses), most accessed first, while the arrays fit in maxBytes
+    HotNodeCache(const FastLCP& l, const std::vector<std::pair<gbwt::node_type,size_type>>& profile, size_type maxBytes);
+
+    //returns the index of node in nodes, gbwt::invalid_offset() if node is not cached
+    size_type find(gbwt::node_type node) const {
+        auto it = std::lower_bound(this->nodes.begin(), this->nodes.end(), node);
+        return (it == this->nodes.end() || *it != node)? gbwt::invalid_offset() : size_type(it - this->nodes.begin());
+    }
+
+    const size_type* suffixes(size_type ind) const { return this->sa.data() + this->starts[ind]; }
+    const size_type* lcps(size_type ind) const { return this->lcp.data() + this->starts[ind]; }
+    size_type nodeSize(size_type ind) const { return this->starts[ind+1] - this->starts[ind]; }
+
+    size_type size() const { return this->nodes.size(); }
+    bool empty() const { return this->nodes.empty(); }
+    static size_type bytesPerSuffix() { return 2*sizeof(size_type); }
+    size_type bytes() const { return this->sa.size()*bytesPerSuffix(); }
+
+    bool verify(const FastLCP& l) const;
+
+    private:
+    //candidates are in decreasing priority
+    void build(const FastLCP& l, const std::vector<gbwt::node_type>& candidates, size_type maxBytes);
+};
+
+HotNodeCache::HotNodeCache(const FastLCP& l, size_type minNodeSize, size_type maxBytes) : HotNodeCache() {
+    const gbwt::GBWT& g = *l.rindex->index;
+    std::vector<std::pair<size_type,gbwt::node_type>> bySize;
+    for (gbwt::comp_type comp = 0; comp < g.effective(); ++comp) {
+        gbwt::node_type node = g.toNode(comp);
+        size_type n = g.nodeSize(node);
+        if (n >= minNodeSize && n != 0)
+            bySize.emplace_back(n, node);
+    }
+    std::sort(bySize.begin(), bySize.end(), [] (const std::pair<size_type,gbwt::node_type>& a, const std::pair<size_type,gbwt::node_type>& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+    std::vector<gbwt::node_type> candidates;
+    candidates.reserve(bySize.size());
+    for (const auto& p : bySize)
+        candidates.push_back(p.second);
+    this->build(l, candidates, maxBytes);
+}
+
+HotNodeCache::HotNodeCache(const FastLCP& l, const std::vector<std::pair<gbwt::node_type,size_type>>& profile, size_type maxBytes) : HotNodeCache() {
+    std::vector<std::pair<gbwt::node_type,size_type>> byAccess(profile);
+    std::sort(byAccess.begin(), byAccess.end(), [] (const std::pair<gbwt::node_type,size_type>& a, const std::pair<gbwt::node_type,size_type>& b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+            });
+    std::vector<gbwt::node_type> candidates;
+    candidates.reserve(byAccess.size());
+    for (const auto& p : byAccess)
+        if (l.rindex->index->contains(p.first))
+            candidates.push_back(p.first);
+    this->build(l, candidates, maxBytes);
+}
+
+void HotNodeCache::build(const FastLCP& l, const std::vector<gbwt::node_type>& candidates, size_type maxBytes) {
+    using namespace gbwt;
+    double start = readTimer();
+    const char msgPrefix[] = "HotNodeCache::build(): ";
+
+    //select nodes, skipping those that do not fit in the remaining budget
+    size_type used = 0;
+    for (node_type node : candidates) {
+        size_type n = l.rindex->index->nodeSize(node);
+        if (n == 0 || n*bytesPerSuffix() > maxBytes - used)
+            continue;
+        if (std::binary_search(this->nodes.begin(), this->nodes.end(), node))
+            continue;
+        this->nodes.insert(std::upper_bound(this->nodes.begin(), this->nodes.end(), node), node);
+        used += n*bytesPerSuffix();
+    }
+
+    this->starts.assign(1, 0);
+    for (node_type node : this->nodes)
+        this->starts.push_back(this->starts.back() + l.rindex->index->nodeSize(node));
+    this->sa.resize(this->starts.back());
+    this->lcp.resize(this->starts.back());
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_type i = 0; i < this->nodes.size(); ++i) {
+        std::vector<size_type> nodeSA = l.decompressSA(this->nodes[i]);
+        std::copy(nodeSA.begin(), nodeSA.end(), this->sa.begin() + this->starts[i]);
+        for (size_type j = this->starts[i]; j < this->starts[i+1]; ++j)
+            this->lcp[j] = l.LCP(this->sa[j]);
+    }
+
+    if(Verbosity::level >= Verbosity::BASIC)
+    {
+        double seconds = readTimer() - start;
+        std::cerr << msgPrefix << "Cached " << this->nodes.size() << " nodes with " << this->sa.size() << " suffixes (" << this->bytes() << " bytes) in " << seconds << " seconds" << std::endl;
+    }
+}
+
+bool HotNodeCache::verify(const FastLCP& l) const {
+    if (this->starts.size() != this->nodes.size() + 1 || this->sa.size() != this->starts.back() || this->lcp.size() != this->starts.back())
+        return false;
+    bool good = true;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_type i = 0; i < this->nodes.size(); ++i) {
+        std::vector<size_type> truth = l.rindex->decompressSA(this->nodes[i]);
+        bool thisNodeGood = truth.size() == this->nodeSize(i) && std::equal(truth.begin(), truth.end(), this->suffixes(i));
+        for (size_type j = 0; thisNodeGood && j < truth.size(); ++j)
+            thisNodeGood = this->lcps(i)[j] == l.LCP(truth[j]);
+        #pragma omp critical
+        {
+            good = good && thisNodeGood;
+        }
+    }
+    return good;
+}
+
+#endif //GBWT_QUERY_HOT_NODE_CACHE_H
@@ -391,8 +391,14 @@ namespace lf_gbwt{
             {
                 return this->inverseLF(position.first, position.second);
             }
+
+            // Returns (inverseLF(from, i), inverseLF(from, j)). The record of the reverse of from, and the record of the
+            // predecessor if i and j have the same one, are looked up once for both.
+            std::pair<gbwt::edge_type, gbwt::edge_type> inverseLF(gbwt::node_type from, size_type i, size_type j) const;
             
             gbwt::node_type predecessorAt(gbwt::node_type, size_type i) const;
+            // As above, with ind = isSmallAndIndex(toComp(revFrom)) for the node revFrom.
+            gbwt::node_type predecessorAt(std::pair<bool, size_type> ind, size_type i) const;
             //------------------------------------------------------------------------------
 
             /*
@@ -494,7 +500,8 @@ namespace lf_gbwt{
                     gbwt::size_type nodeSize = g.nodeSize(node);
                     nodeEqual = nodeEqual && nodeSize == this->nodeSize(node);
                     for (gbwt::size_type j = 0; nodeEqual && j < nodeSize; ++j)
-                        nodeEqual = nodeEqual && this->inverseLF({node, j}) == g.inverseLF({node, j});
+                        nodeEqual = nodeEqual && this->inverseLF({node, j}) == g.inverseLF({node, j})
+                            && this->inverseLF(node, j, nodeSize-1-j) == std::make_pair(g.inverseLF({node, j}), g.inverseLF({node, nodeSize-1-j}));
                     #pragma omp critical 
                     {
                        equal = equal && nodeEqual;
@@ -874,15 +881,18 @@ namespace lf_gbwt{
     //GBWT member functions
 
     gbwt::node_type GBWT::predecessorAt(gbwt::node_type revFrom, size_type i) const {
+        if (this->toComp(revFrom) >= this->effective())
+            std::cout << "In predecessorAt, revFrom " << revFrom << " i " << i << " toComp(revFrom) " << this->toComp(revFrom) << " effective() " << this->effective() << std::endl;
+        return this->predecessorAt(this->isSmallAndIndex(this->toComp(revFrom)), i);
+    }
+
+    gbwt::node_type GBWT::predecessorAt(std::pair<bool, size_type> ind, size_type i) const {
         auto revNode = [this](gbwt::comp_type x) { 
             if (x == gbwt::ENDMARKER) 
                 return x;
             return gbwt::Node::reverse(this->toNode(x));
         };
-        if (this->toComp(revFrom) >= this->effective())
-            std::cout << "In predecessorAt, revFrom " << revFrom << " i " << i << " toComp(revFrom) " << this->toComp(revFrom) << " effective() " << this->effective() << std::endl;
-        auto ind = this->isSmallAndIndex(this->toComp(revFrom));
-        if (i >= this->nodeSize(revFrom))
+        if (i >= ((ind.first)? this->smallRecords.size(ind.second) : this->largeRecords[ind.second].size()))
             return gbwt::invalid_node();
 
         if (ind.first) {
@@ -1355,6 +1365,30 @@ namespace lf_gbwt{
         return { pred, offset};
     }
 
+    std::pair<gbwt::edge_type, gbwt::edge_type> GBWT::inverseLF(gbwt::node_type from, size_type i, size_type j) const {
+        if (!this->bidirectional() || from == gbwt::ENDMARKER) { return {gbwt::invalid_edge(), gbwt::invalid_edge()}; }
+
+        //find the predecessor node ids with one lookup of the reverse record
+        gbwt::node_type revFrom = gbwt::Node::reverse(from);
+        auto revInd = this->isSmallAndIndex(this->toComp(revFrom));
+        gbwt::node_type predI = this->predecessorAt(revInd, i), predJ = this->predecessorAt(revInd, j);
+
+        //determine the offsets, with one lookup of the predecessor record if it is shared
+        auto offsetTo = [this, from] (std::pair<bool, size_type> ind, size_type k) {
+            return (ind.first)? this->smallRecords.offsetTo(ind.second, this->toComp(from), k)
+                : this->largeRecords[ind.second].offsetTo(this->toComp(from), k);
+        };
+        std::pair<gbwt::edge_type, gbwt::edge_type> ans = {gbwt::invalid_edge(), gbwt::invalid_edge()};
+        if (predI != gbwt::invalid_node()) {
+            auto ind = this->isSmallAndIndex(this->toComp(predI));
+            ans.first = {predI, offsetTo(ind, i)};
+            if (predJ == predI) { ans.second = {predJ, offsetTo(ind, j)}; }
+        }
+        if (predJ != gbwt::invalid_node() && predJ != predI)
+            ans.second = {predJ, offsetTo(this->isSmallAndIndex(this->toComp(predJ)), j)};
+        return ans;
+    }
+
     CompressedRecord::size_type CompressedRecord::offsetTo(gbwt::comp_type to, size_type i) const {
         size_type outrank = this->edgeTo(to);
         if (outrank >= this->outdegree() || i < outgoing[outrank]) { return gbwt::invalid_offset(); }
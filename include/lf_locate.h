@@ -0,0 +1,82 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_LF_LOCATE_H
+#define GBWT_QUERY_LF_LOCATE_H
+
+#include<gbwt/gbwt.h>
+#include<gbwt/fast_locate.h>
+#include"fast_lcp.h"
+#include"lf_gbwt.h"
+#include"compText.h"
+
+//LFLocate holds the structures used by versions 3 and 4 of the queries (gbwt::FastLocate, FastLCP, CompText)
+//without a full gbwt::GBWT. They only use their GBWT for the header (toComp, toNode, effective, sequences, contains),
+//so index is a gbwt::GBWT with the header and tags of the lf gbwt and an empty bwt.
+//Functions that read the bwt of index are not supported on these structures:
+//FastLocate::find/locate/decompressSA, FastLCP::decompressSA/verifySuff, HotNodeCache, and CompText construction/verifyText
+class LFLocate{
+    public:
+    gbwt::GBWT index;
+    gbwt::FastLocate r;
+    FastLCP l;
+    CompText ct;
+
+    LFLocate() = default;
+    //the structures point into this object
+    LFLocate(const LFLocate&) = delete;
+    LFLocate& operator=(const LFLocate&) = delete;
+
+    //copies r, l, and ct and points them at a header only copy of lfg
+    LFLocate(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct);
+
+    //loads r, l, and ct from the files written by their serialize functions
+    void load(const lf_gbwt::GBWT& lfg, std::istream& rIn, std::istream& lIn, std::istream& ctIn);
+
+    //copies the header of lfg into index and points r, l, and ct at it
+    void setLFGBWT(const lf_gbwt::GBWT& lfg);
+};
+
+LFLocate::LFLocate(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct) : r(r), l(l), ct(ct) {
+    this->setLFGBWT(lfg);
+}
+
+void LFLocate::load(const lf_gbwt::GBWT& lfg, std::istream& rIn, std::istream& lIn, std::istream& ctIn) {
+    this->r.load(rIn);
+    this->l.load(lIn);
+    this->ct.load(ctIn);
+    this->setLFGBWT(lfg);
+}
+
+void LFLocate::setLFGBWT(const lf_gbwt::GBWT& lfg) {
+    this->index = gbwt::GBWT();
+    this->index.header = lfg.header;
+    this->index.tags = lfg.tags;
+    this->r.setGBWT(this->index);
+    this->l.rindex = &this->r;
+    this->ct.source = &this->l;
+}
+
+#endif //GBWT_QUERY_LF_LOCATE_H
@@ -73,294 +73,272 @@ longMatchQueryBrute(const gbwt::GBWT& x, const gbwt::size_type L, const gbwt::ve
 
 //(start position in Q, length, path ID, start position in path)
 //assumes gbwt::ENDMARKER Is not in Q
-std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-longMatchQuery2(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q) {
-    //std::cout << "L2" << std::endl;
-    //std::cout << "In longMatchQuery2" << std::endl;
+//long matches of length at least L of Q on any index (see IndexTraits) with the buffers in scratch, matches are written to matches
+//(a vector or callable, see emitMatch). The lcps are compared on ct if it is given and walked otherwise, see queryLcps.
+//Versions 2, 3, 4, and 2_4 are this query on gbwt::GBWT and lf_gbwt::GBWT, without and with ct
+template<class Index, class Sink>
+void longMatchQueryT(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
     for (gbwt::node_type a : Q)
-        if (!x.contains(a) || x.nodeSize(a) == 0)
-            return {};
-    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!x.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return;
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size()) { return; }
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
-
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffGBWT(x, r, l, Qs);
-    //std::cout << "a: " ;
-    //for (auto x : a)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "s: " ;
-    //for (auto x : s)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowGBWT(x, a, Qs);
-    //std::cout << "lcpa: " ;
-    //for (auto x : lcpa)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "lcpb: " ;
-    //for (auto x : lcpb)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+    const gbwt::vector_type& Qs = scratch.Qs;
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s, & lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    queryLcps(g, l, ct, scratch);
 
     //block is [f^L_i, g^L_i - 1]
     //assumes a.back() = 0 and Qs.back() = gbwt::ENDMARKER
     gbwt::range_type block = gbwt::Range::empty_range();
     gbwt::size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset();
-    std::map<gbwt::size_type,gbwt::size_type> inBlock;
+    SuffixBlockMap& inBlock = scratch.inBlock;
+    inBlock.clear();
+    auto filter = matchFilter(matches);
     for (gbwt::size_type i = Qs.size()-1; i != 0; --i){
-        //std::cout << "block: [" << block.first << "," << block.second << "]" << std::endl;
-        //std::cout << "topSuff: " << topSuff << " botSuff: " << botSuff << std::endl;
-        //std::cout << "inBlock: ";
-        //for (auto a: inBlock) 
-            //std::cout << "(" <<  a.first << ":" << a.second << ") ";
-        //std::cout << std::endl;
-        assert(inBlock.size() == gbwt::Range::length(block));
-        //output matches
-        std::tie(block, topSuff, botSuff) = AddLongMatchesFastLCP(x, r, l, inBlock, i, Qs, block, topSuff, botSuff, matches);
-        //std::cout << "midblock: [" << block.first << "," << block.second << "]" << std::endl;
-        //std::cout << "topSuff " << topSuff << " botSuff " << botSuff << std::endl;
+        assert(blockMapAgrees(inBlock, block, filter));
+        //output matches leaving last block and update block to [f^{L+1}_{i-1}, g^{L+1}_{i-1} - 1]
+        std::tie(block, topSuff, botSuff) = IndexTraits<Index>::AddLongMatches(g, r, l, inBlock, i, Qs, block, topSuff, botSuff, matches, hot);
         //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
         assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
         //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
         assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
-        assert(inBlock.size() == gbwt::Range::length(block));
+        assert(blockMapAgrees(inBlock, block, filter));
 
         //compute block [f^L_{i-1}, g^L_{i-1} - 1]
         if (gbwt::Range::empty(block) && std::max(lcpa[i-1], lcpb[i-1]) >= L) {
-            std::tie(block, topSuff, botSuff) = LongMatchesFastLCPInitializeEmptyBlock(r, l, inBlock, a[i-1], Qs[i-1], x.nodeSize(Qs[i-1]), s[i-1], lcpa[i-1], lcpb[i-1], Qs.size(), i - 1, L);
+            std::tie(block, topSuff, botSuff) = LongMatchesFastLCPInitializeEmptyBlock(r, l, inBlock, a[i-1], Qs[i-1], g.nodeSize(Qs[i-1]), s[i-1], lcpa[i-1], lcpb[i-1], Qs.size(), i - 1, L, filter);
             //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
             assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
             //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
             assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
         }
-        assert(inBlock.size() == gbwt::Range::length(block));
+        assert(blockMapAgrees(inBlock, block, filter));
         if (!gbwt::Range::empty(block)) {
-            std::tie(block, topSuff, botSuff) = LongMatchesExpandNonEmptyBlock(r, l, inBlock, x.nodeSize(Qs[i-1]), block, topSuff, botSuff, Qs.size(), i - 1, L);
+            std::tie(block, topSuff, botSuff) = LongMatchesExpandNonEmptyBlock(r, l, inBlock, g.nodeSize(Qs[i-1]), block, topSuff, botSuff, Qs.size(), i - 1, L, hot, Qs[i-1], filter);
         }
-        assert(inBlock.size() == gbwt::Range::length(block));
+        assert(blockMapAgrees(inBlock, block, filter));
     }
-    //std::cout << "block: [" << block.first << "," << block.second << "]" << std::endl;
-    AddLongMatchesWholeBlock(r, l, inBlock, 0, Qs, block, topSuff, matches);
+    AddLongMatchesWholeBlock(r, l, inBlock, 0, Qs, block, topSuff, matches, hot);
     assert(inBlock.empty());
-    //std::cout << "Leaving longMatchQuery2" << std::endl;
+}
+
+//(start position in Q, length, path ID, start position in path)
+//assumes gbwt::ENDMARKER Is not in Q
+//longMatchQuery2 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void longMatchQuery2(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    longMatchQueryT(x, r, l, nullptr, L, Q, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+longMatchQuery2(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    longMatchQuery2(x, r, l, L, Q, scratch, matches, hot);
     return matches;
 }
 
+//longMatchQuery3 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void longMatchQuery3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    longMatchQueryT(lfg, r, l, nullptr, L, Q, scratch, matches, hot);
+}
+
 std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-longMatchQuery3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q) {
-    //std::cout << "In longMatchQuery3" << std::endl;
-    for (gbwt::node_type a : Q)
-        if (!lfg.contains(a) || lfg.nodeSize(a) == 0)
-            return {};
+longMatchQuery3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
     std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+    longMatchQuery3(lfg, r, l, L, Q, scratch, matches, hot);
+    return matches;
+}
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
-
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffLFGBWT(lfg, r, l, Qs);
-    //std::cout << "a: " ;
-    //for (auto x : a)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "s: " ;
-    //for (auto x : s)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowLFGBWT(lfg, a, Qs);
-    //std::cout << "lcpa: " ;
-    //for (auto x : lcpa)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "lcpb: " ;
-    //for (auto x : lcpb)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
 
-    gbwt::range_type block = gbwt::Range::empty_range();
-    gbwt::size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset();
-    std::map<gbwt::size_type,gbwt::size_type> inBlock;
-    for (gbwt::size_type i = Qs.size()-1; i != 0; --i) {
-        //std::cout << "block: [" << block.first << "," << block.second << "]" << std::endl;
-        //std::cout << "topSuff: " << topSuff << " botSuff: " << botSuff << std::endl;
-        //std::cout << "inBlock: ";
-        //for (auto a: inBlock) 
-            //std::cout << "(" <<  a.first << ":" << a.second << ") ";
-        //std::cout << std::endl;
-        assert(inBlock.size() == gbwt::Range::length(block));
-        //output matches leaving last block and update block to [f^{L+1}_{i-1}, g^{L+1}_{i-1} - 1]
-        std::tie(block, topSuff, botSuff) = AddLongMatchesLFGBWT(lfg, r, l, inBlock, i, Qs, block, topSuff, botSuff, matches);
-        //std::cout << "midblock: [" << block.first << "," << block.second << "]" << std::endl;
-        //std::cout << "topSuff " << topSuff << " botSuff " << botSuff << std::endl;
-        //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-        assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
-        //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
-        assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
-        assert(inBlock.size() == gbwt::Range::length(block));
+//(start position in Q, length, path ID, start position in path)
+//assumes gbwt::ENDMARKER Is not in Q
+//longMatchQuery4 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void longMatchQuery4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    longMatchQueryT(lfg, r, l, &ct, L, Q, scratch, matches, hot);
+}
 
-        //std::cout << "Computing next block" << std::endl;
-        //compute block [f^L_{i-1}, g^L_{i-1} - 1]
-        if(gbwt::Range::empty(block) && std::max(lcpa[i-1], lcpb[i-1]) >= L) {
-            std::tie(block, topSuff, botSuff) = LongMatchesFastLCPInitializeEmptyBlock(r, l, inBlock, a[i-1], Qs[i-1], lfg.nodeSize(Qs[i-1]), s[i-1], lcpa[i-1], lcpb[i-1], Qs.size(), i - 1, L);
-            //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-            assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
-            //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
-            assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
-        }
-        assert(inBlock.size() == gbwt::Range::length(block));
-        if (!gbwt::Range::empty(block)) {
-            std::tie(block, topSuff, botSuff) = LongMatchesExpandNonEmptyBlock(r, l, inBlock, lfg.nodeSize(Qs[i-1]), block, topSuff, botSuff, Qs.size(), i - 1, L);
-        }
-        assert(inBlock.size() == gbwt::Range::length(block));
-    }
-    //std::cout << "block: [" << block.first << "," << block.second << "]" << std::endl;
-    AddLongMatchesWholeBlock(r, l, inBlock, 0, Qs, block, topSuff, matches);
-    assert(inBlock.empty());
-    //std::cout << "Leaving longMatchQuery3" << std::endl;
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+longMatchQuery4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    longMatchQuery4(lfg, r, l, ct, L, Q, scratch, matches, hot);
     return matches;
 }
 
 
 //(start position in Q, length, path ID, start position in path)
 //assumes gbwt::ENDMARKER Is not in Q
+//longMatchQuery2_4 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void longMatchQuery2_4(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    longMatchQueryT(x, r, l, &ct, L, Q, scratch, matches, hot);
+}
+
 std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-longMatchQuery4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q) {
-    //std::cout << "In longMatchQuery4" << std::endl;
-    for(gbwt::node_type a : Q)
-        if (!lfg.contains(a) || lfg.nodeSize(a) == 0)
-            return {};
+longMatchQuery2_4(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
     std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+    longMatchQuery2_4(x, r, l, ct, L, Q, scratch, matches, hot);
+    return matches;
+}
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
-
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffLFGBWT(lfg, r, l, Qs);
-    //std::cout << "a: " ;
-    //for (auto x : a)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "s: " ;
-    //for (auto x : s)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowCT(lfg, l, ct, a, s, Qs);
-    //std::cout << "lcpa: " ;
-    //for (auto x : lcpa)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "lcpb: " ;
-    //for (auto x : lcpb)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    
-    gbwt::range_type block = gbwt::Range::empty_range();
-    gbwt::size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset();
-    std::map<gbwt::size_type,gbwt::size_type> inBlock;
-    for (gbwt::size_type i = Qs.size()-1; i != 0; --i) {
-        //std::cout << "block: [" << block.first << "," << block.second << "]" << std::endl;
-        //std::cout << "topSuff: " << topSuff << " botSuff: " << botSuff << std::endl;
-        //std::cout << "inBlock: ";
-        //for (auto a: inBlock) 
-            //std::cout << "(" <<  a.first << ":" << a.second << ") ";
-        //std::cout << std::endl;
-        assert(inBlock.size() == gbwt::Range::length(block));
-        //output matches leaving last block and update block to [f^{L+1}_{i-1}, g^{L+1}_{i-1} - 1]
-        std::tie(block, topSuff, botSuff) = AddLongMatchesLFGBWT(lfg, r, l, inBlock, i, Qs, block, topSuff, botSuff, matches);
-        //std::cout << "midblock: [" << block.first << "," << block.second << "]" << std::endl;
-        //std::cout << "topSuff " << topSuff << " botSuff " << botSuff << std::endl;
-        //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-        //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-        assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
-        //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
-        assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
-        assert(inBlock.size() == gbwt::Range::length(block));
+//------------------------------------------------------------------------------
+//Long matches for several thresholds
 
-        //compute block [f^L_{i-1}, g^L_{i-1} - 1]
-        if(gbwt::Range::empty(block) && std::max(lcpa[i-1], lcpb[i-1]) >= L) {
-            std::tie(block, topSuff, botSuff) = LongMatchesFastLCPInitializeEmptyBlock(r, l, inBlock, a[i-1], Qs[i-1], lfg.nodeSize(Qs[i-1]), s[i-1], lcpa[i-1], lcpb[i-1], Qs.size(), i - 1, L);
-            //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-            assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
-            //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
-            assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
-        }
-        assert(inBlock.size() == gbwt::Range::length(block));
+//long matches of length at least L are exactly the long matches of length at least Ls.front() that are at least L long,
+//so one query with the smallest threshold finds the long matches of every threshold in Ls
+//each match is tagged with the number of thresholds it satisfies, it is a long match for Ls[0], ..., Ls[tag-1]
 
-        if (!gbwt::Range::empty(block)) {
-            std::tie(block, topSuff, botSuff) = LongMatchesExpandNonEmptyBlock(r, l, inBlock, lfg.nodeSize(Qs[i-1]), block, topSuff, botSuff, Qs.size(), i - 1, L);
-        }
-        assert(inBlock.size() == gbwt::Range::length(block));
+//(start position in Q, length, path ID, start position in path, number of thresholds satisfied)
+typedef std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type> tagged_match_type;
+
+template<class Sink>
+inline void emitTaggedMatch(Sink& sink, gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart, gbwt::size_type tag) {
+    sink(start, len, path, pathStart, tag);
+}
+
+inline void emitTaggedMatch(std::vector<tagged_match_type>& matches, gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart, gbwt::size_type tag) {
+    matches.emplace_back(start, len, path, pathStart, tag);
+}
+
+//sink of long matches for Ls.front() that tags them and writes them to sink (a vector of tagged_match_type or a callable taking 5 arguments)
+template<class Sink>
+struct ThresholdTagSink {
+    const std::vector<gbwt::size_type>& Ls;
+    Sink& sink;
+
+    void operator()(gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+        emitTaggedMatch(this->sink, start, len, path, pathStart, std::upper_bound(this->Ls.begin(), this->Ls.end(), len) - this->Ls.begin());
     }
-    //std::cout << "block: [" << block.first << "," << block.second << "]" << std::endl;
-    AddLongMatchesWholeBlock(r, l, inBlock, 0, Qs, block, topSuff, matches);
-    assert(inBlock.empty());
-    //std::cout << "Leaving longMatchQuery4" << std::endl;
+};
+
+//Ls must be nonempty, positive, and strictly increasing
+void checkThresholds(const std::vector<gbwt::size_type>& Ls) {
+    if (Ls.empty() || Ls.front() == 0) { throw std::invalid_argument("Long match thresholds must be nonempty and positive!"); }
+    for (gbwt::size_type i = 1; i < Ls.size(); ++i)
+        if (Ls[i-1] >= Ls[i]) { throw std::invalid_argument("Long match thresholds must be strictly increasing!"); }
+}
+
+//long matches of version 2 for every threshold in Ls, tagged with the number of thresholds satisfied
+template<class Sink>
+void longMatchQueryMultiL2(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    checkThresholds(Ls);
+    ThresholdTagSink<Sink> tagged{Ls, matches};
+    longMatchQuery2(x, r, l, Ls.front(), Q, scratch, tagged, hot);
+}
+
+std::vector<tagged_match_type>
+longMatchQueryMultiL2(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<tagged_match_type> matches;
+    longMatchQueryMultiL2(x, r, l, Ls, Q, scratch, matches, hot);
     return matches;
 }
 
+//long matches of version 3 for every threshold in Ls, tagged with the number of thresholds satisfied
+template<class Sink>
+void longMatchQueryMultiL3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    checkThresholds(Ls);
+    ThresholdTagSink<Sink> tagged{Ls, matches};
+    longMatchQuery3(lfg, r, l, Ls.front(), Q, scratch, tagged, hot);
+}
 
-//(start position in Q, length, path ID, start position in path)
-//assumes gbwt::ENDMARKER Is not in Q
-std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-longMatchQuery2_4(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q) {
-    for(gbwt::node_type a : Q)
-        if (!x.contains(a) || x.nodeSize(a) == 0)
-            return {};
-    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!x.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+std::vector<tagged_match_type>
+longMatchQueryMultiL3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<tagged_match_type> matches;
+    longMatchQueryMultiL3(lfg, r, l, Ls, Q, scratch, matches, hot);
+    return matches;
+}
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
+//long matches of version 4 for every threshold in Ls, tagged with the number of thresholds satisfied
+template<class Sink>
+void longMatchQueryMultiL4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    checkThresholds(Ls);
+    ThresholdTagSink<Sink> tagged{Ls, matches};
+    longMatchQuery4(lfg, r, l, ct, Ls.front(), Q, scratch, tagged, hot);
+}
 
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffGBWT(x, r, l, Qs);
+std::vector<tagged_match_type>
+longMatchQueryMultiL4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<tagged_match_type> matches;
+    longMatchQueryMultiL4(lfg, r, l, ct, Ls, Q, scratch, matches, hot);
+    return matches;
+}
 
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowCT(x, l, ct, a, s, Qs);
+//long matches of version 2_4 for every threshold in Ls, tagged with the number of thresholds satisfied
+template<class Sink>
+void longMatchQueryMultiL2_4(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    checkThresholds(Ls);
+    ThresholdTagSink<Sink> tagged{Ls, matches};
+    longMatchQuery2_4(x, r, l, ct, Ls.front(), Q, scratch, tagged, hot);
+}
 
-    gbwt::range_type block = gbwt::Range::empty_range();
-    gbwt::size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset();
-    std::map<gbwt::size_type,gbwt::size_type> inBlock;
-    for (gbwt::size_type i = Qs.size()-1; i != 0; --i){
-        assert(inBlock.size() == gbwt::Range::length(block));
-        //output matches
-        std::tie(block, topSuff, botSuff) = AddLongMatchesFastLCP(x, r, l, inBlock, i, Qs, block, topSuff, botSuff, matches);
-        //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-        assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
-        //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
-        assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
+std::vector<tagged_match_type>
+longMatchQueryMultiL2_4(const gbwt::GBWT& x, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<tagged_match_type> matches;
+    longMatchQueryMultiL2_4(x, r, l, ct, Ls, Q, scratch, matches, hot);
+    return matches;
+}
+//------------------------------------------------------------------------------
 
-        assert(inBlock.size() == gbwt::Range::length(block));
+//------------------------------------------------------------------------------
+//Long match counts
+
+//(start position in Q, length, count) for each maximal interval Q[start, start+length) whose windows of length L all occur
+//count > 0 times in the paths, in order of start, so every window of Q covered by long matches is in one interval. count is
+//the size of the long match block of the window, the number of long matches covering it, read off the block (see countBlockStep)
+//so only the suffixes at the edges of the blocks are located. Counts are written to counts, the lcps are as in longMatchQueryT
+template<class Index>
+void longMatchCountQueryT(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::size_type L, const gbwt::vector_type& Q, QueryScratch& scratch,
+        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>& counts, const HotNodeCache* hot = nullptr) {
+    for (gbwt::node_type a : Q)
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return;
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size() || L == 0) { return; }
 
-        //compute block [f^L_{i-1}, g^L_{i-1} - 1]
-        if (gbwt::Range::empty(block) && std::max(lcpa[i-1], lcpb[i-1]) >= L) {
-            std::tie(block, topSuff, botSuff) = LongMatchesFastLCPInitializeEmptyBlock(r, l, inBlock, a[i-1], Qs[i-1], x.nodeSize(Qs[i-1]), s[i-1], lcpa[i-1], lcpb[i-1], Qs.size(), i - 1, L);
-            //assert if block empty topSuff, botSuff = gbwt::invalid_offset()
-            assert(!gbwt::Range::empty(block) || (botSuff == gbwt::invalid_offset() && topSuff == gbwt::invalid_offset()));
-            //assert if block not empty, topsuff, botsuff != gbwt::invalid_offset()
-            assert( gbwt::Range::empty(block) || (botSuff != gbwt::invalid_offset() && topSuff != gbwt::invalid_offset()));
-        }
-        assert(inBlock.size() == gbwt::Range::length(block));
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+    const std::vector<gbwt::size_type>& lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    queryLcps(g, l, ct, scratch);
 
-        if (!gbwt::Range::empty(block)) {
-            std::tie(block, topSuff, botSuff) = LongMatchesExpandNonEmptyBlock(r, l, inBlock, x.nodeSize(Qs[i-1]), block, topSuff, botSuff, Qs.size(), i - 1, L);
+    gbwt::range_type block = gbwt::Range::empty_range();
+    gbwt::size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset();
+    scratch.inBlock.clear();
+    //the current interval is Q[start, end) with count, none if count = 0
+    gbwt::size_type start = 0, end = 0, count = 0, size;
+    for (gbwt::size_type k = scratch.Qs.size()-1; k-- != 0;){
+        std::tie(block, topSuff, botSuff) = countBlockStep(g, r, l, scratch, k, (std::max(lcpa[k], lcpb[k]) >= L)? L : 0, block, topSuff, botSuff, hot);
+        //the block at k is of the window Q[Q.size()-k-L, Q.size()-k)
+        size = (gbwt::Range::empty(block))? 0 : gbwt::Range::length(block);
+        if (size != count) {
+            if (count) { counts.emplace_back(start, end - start, count); }
+            start = Q.size() - k - ((size)? L : 0);
+            count = size;
         }
-        assert(inBlock.size() == gbwt::Range::length(block));
+        end = Q.size() - k;
     }
-    AddLongMatchesWholeBlock(r, l, inBlock, 0, Qs, block, topSuff, matches);
-    assert(inBlock.empty());
-    return matches;
+    if (count) { counts.emplace_back(start, end - start, count); }
 }
+
+//(start position in Q, length, count) of the intervals of Q whose windows of length L occur count times, see longMatchCountQueryT
+//on either index, ct is optional
+template<class Index>
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+longMatchCountQuery(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::size_type L, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>> counts;
+    longMatchCountQueryT(g, r, l, ct, L, Q, scratch, counts, hot);
+    return counts;
+}
+//------------------------------------------------------------------------------
+
 #endif //GBWT_QUERY_LONGMATCHQUERY_H
@@ -0,0 +1,189 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_ONLINELONGMATCHQUERY_H
+#define GBWT_QUERY_ONLINELONGMATCHQUERY_H
+
+#include<querySupport.h>
+#include<vector>
+#include<limits>
+#include<stdexcept>
+
+//the last nodes of Qs = reverse(Q) + ENDMARKER of a query that is read online, indexed as if Qs had size() positions
+//after d nodes of Q are read, the node of depth d (Q[d-1], or the ENDMARKER for d = 0) is at position size() - 1 - d
+//only the last capacity nodes are kept
+class QsWindow {
+    public:
+    typedef gbwt::size_type size_type;
+
+    explicit QsWindow(size_type capacity) : nodes(capacity) { this->nodes[0] = gbwt::ENDMARKER; }
+
+    size_type size() const { return virtualSize(); }
+    //number of nodes of Q read
+    size_type depth() const { return this->d; }
+    //position of the last node read
+    size_type last() const { return virtualSize() - 1 - this->d; }
+    //position i to depth and to the slot of the node of that depth
+    size_type toDepth(size_type i) const { return virtualSize() - 1 - i; }
+    size_type slot(size_type i) const {
+        assert(i >= this->last() && this->toDepth(i) + this->nodes.size() > this->d);
+        return this->toDepth(i) % this->nodes.size(); 
+    }
+
+    gbwt::node_type operator[](size_type i) const { return this->nodes[this->slot(i)]; }
+    void push(gbwt::node_type node) {
+        ++this->d;
+        this->nodes[this->d % this->nodes.size()] = node;
+    }
+
+    //larger than the length of any query read online
+    static constexpr size_type virtualSize() { return std::numeric_limits<size_type>::max() >> 2; }
+
+    private:
+    std::vector<gbwt::node_type> nodes;
+    size_type d = 0;
+};
+
+//OnlineLongMatchQuery finds the long matches of version 2 (Index = gbwt::GBWT) or version 3 (Index = lf_gbwt::GBWT)
+//of a query whose nodes arrive in chunks, matches are written as soon as they are closed
+//memory is the active block plus a window of the last L+1 positions of the query, 
+//so the lcps above and below are only computed up to L, the only values the block computation distinguishes
+//every node of the query must be in the index (a node that is not is an std::invalid_argument), 
+//then the matches are those of longMatchQuery2 or longMatchQuery3 on the whole query
+template<class Index>
+class OnlineLongMatchQuery {
+    public:
+    typedef gbwt::size_type size_type;
+
+    OnlineLongMatchQuery(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const size_type L, const HotNodeCache* hot = nullptr, size_type expectedBlockSize = 0);
+
+    //reads the next nodes of Q, the matches that end before them are written to matches (a vector or callable, see emitMatch)
+    //a FilteredSink must have the same filter for every call on one query
+    template<class Sink>
+    void append(const gbwt::vector_type& chunk, Sink& matches);
+    template<class Sink>
+    void append(gbwt::node_type node, Sink& matches);
+    //writes the matches that end at the end of Q, no nodes can be appended after
+    template<class Sink>
+    void finish(Sink& matches);
+
+    //number of nodes of Q read
+    size_type size() const { return this->Qs.depth(); }
+
+    private:
+    const Index* g;
+    const gbwt::FastLocate* r;
+    const FastLCP* l;
+    const HotNodeCache* hot;
+    size_type L;
+    bool finished = false;
+
+    //window of Qs, and a, lcpa, lcpb in the slots of Qs
+    QsWindow Qs;
+    std::vector<size_type> a, lcpa, lcpb;
+    //suffix below the last position
+    size_type s;
+
+    SuffixBlockMap inBlock;
+    gbwt::range_type block = gbwt::Range::empty_range();
+    size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset();
+
+    //lcp of Qs[k...] and the suffix at edge in the direction of Qs[k...] up to L, 
+    //stops early where edge joins the suffix next to Qs[k+lcp...] (above or below by neighbor, lcps in lcps)
+    size_type cappedLCP(size_type k, gbwt::edge_type edge, bool above, const std::vector<size_type>& lcps) const;
+};
+
+template<class Index>
+OnlineLongMatchQuery<Index>::OnlineLongMatchQuery(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const size_type L, const HotNodeCache* hot, size_type expectedBlockSize)
+    : g(&g), r(&r), l(&l), hot(hot), L(L), Qs(L + 1), a(L + 1), lcpa(L + 1), lcpb(L + 1), inBlock(expectedBlockSize) {
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (L == 0) { throw std::invalid_argument("Online long match queries need L > 0!"); }
+    //position of the ENDMARKER
+    this->a[0] = 0;
+    this->s = r.locateFirst(gbwt::ENDMARKER);
+    this->lcpa[0] = this->lcpb[0] = 0;
+}
+
+template<class Index>
+typename OnlineLongMatchQuery<Index>::size_type
+OnlineLongMatchQuery<Index>::cappedLCP(size_type k, gbwt::edge_type edge, bool above, const std::vector<size_type>& lcps) const {
+    size_type lcp = 0;
+    while (lcp < this->L && edge.first == this->Qs[k+lcp] && edge.first != gbwt::ENDMARKER) {
+        ++lcp;
+        edge = this->g->inverseLF(edge);
+        if (lcp < this->L && edge.first == this->Qs[k+lcp] && edge.second + above == this->a[this->Qs.slot(k+lcp)])
+            return std::min(this->L, lcp + lcps[this->Qs.slot(k+lcp)]);
+    }
+    return lcp;
+}
+
+template<class Index>
+template<class Sink>
+void OnlineLongMatchQuery<Index>::append(gbwt::node_type node, Sink& matches) {
+    if (this->finished) { throw std::invalid_argument("Nodes appended to a finished online long match query!"); }
+    if (node == gbwt::ENDMARKER || !this->g->contains(node) || this->g->nodeSize(node) == 0) { throw std::invalid_argument("Online long match query node is not in the GBWT!"); }
+    size_type i = this->Qs.last(), prevPos = this->a[this->Qs.slot(i)];
+    this->Qs.push(node);
+    size_type k = i - 1, slot = this->Qs.slot(k), nodeSize = this->g->nodeSize(node);
+
+    //virtual insertion and lcps of the new position
+    std::tie(this->a[slot], this->s) = IndexTraits<Index>::LFWithSuff(*this->g, *this->r, *this->l, prevPos, this->s, this->Qs[i], node);
+    this->lcpa[slot] = (this->a[slot] == 0)? 0 : this->cappedLCP(k, {node, this->a[slot]-1}, true, this->lcpa);
+    this->lcpb[slot] = (this->a[slot] == nodeSize)? 0 : this->cappedLCP(k, {node, this->a[slot]}, false, this->lcpb);
+
+    //same as an iteration of longMatchQuery2 and longMatchQuery3
+    auto filter = matchFilter(matches);
+    assert(blockMapAgrees(this->inBlock, this->block, filter));
+    std::tie(this->block, this->topSuff, this->botSuff) = IndexTraits<Index>::AddLongMatches(*this->g, *this->r, *this->l, this->inBlock, i, this->Qs, this->block, this->topSuff, this->botSuff, matches, this->hot);
+    if (gbwt::Range::empty(this->block) && std::max(this->lcpa[slot], this->lcpb[slot]) >= this->L) {
+        std::tie(this->block, this->topSuff, this->botSuff) = LongMatchesFastLCPInitializeEmptyBlock(*this->r, *this->l, this->inBlock, this->a[slot], node, nodeSize, this->s, 
+                this->lcpa[slot], this->lcpb[slot], this->Qs.size(), k, this->L, filter);
+    }
+    if (!gbwt::Range::empty(this->block)) {
+        std::tie(this->block, this->topSuff, this->botSuff) = LongMatchesExpandNonEmptyBlock(*this->r, *this->l, this->inBlock, nodeSize, this->block, this->topSuff, this->botSuff, 
+                this->Qs.size(), k, this->L, this->hot, node, filter);
+    }
+    assert(blockMapAgrees(this->inBlock, this->block, filter));
+}
+
+template<class Index>
+template<class Sink>
+void OnlineLongMatchQuery<Index>::append(const gbwt::vector_type& chunk, Sink& matches) {
+    for (gbwt::node_type node : chunk)
+        this->append(node, matches);
+}
+
+template<class Index>
+template<class Sink>
+void OnlineLongMatchQuery<Index>::finish(Sink& matches) {
+    if (this->finished) { return; }
+    this->finished = true;
+    if (this->Qs.depth() == 0) { return; }
+    AddLongMatchesWholeBlock(*this->r, *this->l, this->inBlock, this->Qs.last(), this->Qs, this->block, this->topSuff, matches, this->hot);
+    assert(this->inBlock.empty());
+    this->block = gbwt::Range::empty_range();
+}
+
+#endif //GBWT_QUERY_ONLINELONGMATCHQUERY_H
@@ -0,0 +1,249 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_PARALLELQUERY_H
+#define GBWT_QUERY_PARALLELQUERY_H
+
+#include<setMaximalMatchQuery.h>
+#include<longMatchQuery.h>
+#include<vector>
+#include<tuple>
+#include<algorithm>
+#include<omp.h>
+
+//Intra-query parallelism for very long queries with versions 3 and 4.
+//Virtual insertion is sequential (a[k] depends on a[k+1]) but only costs one LF per position,
+//Qs is then split into segments and the lcp and reporting phases of each segment run on their own OpenMP thread.
+//Set maximal matches are reported at a single position k, so segments partition the reports.
+//A long match block is rebuilt from scratch at the top of each segment (see LongMatchesFastLCPBuildBlock) and a long match
+//is reported at the transition where it leaves the block, so every match is reported by exactly one segment
+//and no overlap or deduplication between segments is needed. Matches are buffered per segment and written to matches
+//in the order of the sequential query.
+
+//queries shorter than this many nodes per thread are not split when the number of segments is chosen automatically
+constexpr gbwt::size_type minQuerySegmentLength = 4096;
+
+//bounds[t] to bounds[t+1] is segment t of [0, n), segments == 0 uses up to one segment per thread
+std::vector<gbwt::size_type> querySegmentBounds(const gbwt::size_type n, gbwt::size_type segments) {
+    if (segments == 0) { segments = std::min<gbwt::size_type>(omp_get_max_threads(), n / minQuerySegmentLength); }
+    segments = std::max<gbwt::size_type>(1, std::min(segments, n));
+    std::vector<gbwt::size_type> bounds(segments + 1);
+    for (gbwt::size_type t = 0; t <= segments; ++t)
+        bounds[t] = n * t / segments;
+    return bounds;
+}
+
+//reports the set maximal matches with k in [kBegin, kEnd), assumes lcpa and lcpb are computed for [kBegin-1, kEnd)
+template<class Sink>
+void setMaximalMatchSegmentLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q,
+        const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const std::vector<gbwt::size_type>& lcpa, const std::vector<gbwt::size_type>& lcpb,
+        const gbwt::size_type kBegin, const gbwt::size_type kEnd, Sink& matches, const HotNodeCache* hot = nullptr) {
+    gbwt::size_type prev = (kBegin == 0)? 0 : std::max(lcpa[kBegin-1], lcpb[kBegin-1]), len;
+    for (gbwt::size_type k = kBegin; k < kEnd; ++k){
+        len = std::max(lcpa[k], lcpb[k]);
+        if (len >= prev){
+            AddMatchesFastLCPLFGBWT(lfg, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], matches, hot);
+        }
+        prev = len;
+    }
+}
+
+//runs the long match block from Qs[hi] to Qs[lo], reporting the matches leaving the block on the transitions from i to i-1 for lo <= i <= hi,
+//or emptying the block at Qs[0] if lo == 0. Only lcpa and lcpb in [lo, hi] are read
+template<class Sink>
+void longMatchSegmentLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Qs,
+        const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const std::vector<gbwt::size_type>& lcpa, const std::vector<gbwt::size_type>& lcpb,
+        const gbwt::size_type hi, const gbwt::size_type lo, SuffixBlockMap& inBlock, Sink& matches, const HotNodeCache* hot = nullptr) {
+    gbwt::range_type block;
+    gbwt::size_type topSuff, botSuff;
+    inBlock.clear();
+    auto filter = matchFilter(matches);
+    std::tie(block, topSuff, botSuff) = LongMatchesFastLCPBuildBlock(r, l, inBlock, a[hi], Qs[hi], lfg.nodeSize(Qs[hi]), s[hi], lcpa[hi], lcpb[hi], Qs.size(), hi, L, filter);
+    for (gbwt::size_type i = hi; i != 0; --i) {
+        assert(blockMapAgrees(inBlock, block, filter));
+        std::tie(block, topSuff, botSuff) = AddLongMatchesLFGBWT(lfg, r, l, inBlock, i, Qs, block, topSuff, botSuff, matches, hot);
+        //the block at i-1 is rebuilt by the next segment
+        if (i == lo) { inBlock.clear(); return; }
+        if(gbwt::Range::empty(block) && std::max(lcpa[i-1], lcpb[i-1]) >= L) {
+            std::tie(block, topSuff, botSuff) = LongMatchesFastLCPInitializeEmptyBlock(r, l, inBlock, a[i-1], Qs[i-1], lfg.nodeSize(Qs[i-1]), s[i-1], lcpa[i-1], lcpb[i-1], Qs.size(), i - 1, L, filter);
+        }
+        if (!gbwt::Range::empty(block)) {
+            std::tie(block, topSuff, botSuff) = LongMatchesExpandNonEmptyBlock(r, l, inBlock, lfg.nodeSize(Qs[i-1]), block, topSuff, botSuff, Qs.size(), i - 1, L, hot, Qs[i-1], filter);
+        }
+    }
+    AddLongMatchesWholeBlock(r, l, inBlock, 0, Qs, block, topSuff, matches, hot);
+    assert(inBlock.empty());
+}
+
+//writes the buffered matches of each segment to matches, segments are taken from last to first if reverse is set
+template<class Sink>
+void emitSegmentMatches(std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>>& segmentMatches, Sink& matches, const bool reverse) {
+    for (gbwt::size_type i = 0; i < segmentMatches.size(); ++i) {
+        auto& buffer = segmentMatches[(reverse)? segmentMatches.size() - 1 - i : i];
+        for (const auto& m : buffer)
+            emitMatch(matches, std::get<0>(m), std::get<1>(m), std::get<2>(m), std::get<3>(m));
+        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>().swap(buffer);
+    }
+}
+
+//setMaximalMatchQuery3 (ct == nullptr) or setMaximalMatchQuery4 with the lcp and reporting phases split into segments, see querySegmentBounds
+template<class Sink>
+void setMaximalMatchQueryParallelLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::vector_type& Q, const gbwt::size_type segments, 
+        QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    for (gbwt::node_type a : Q)
+        if (!lfg.contains(a) || lfg.nodeSize(a) == 0)
+            return;
+    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size()) { return; }
+    std::vector<gbwt::size_type> bounds = querySegmentBounds(Q.size() + 1, segments);
+    if (bounds.size() == 2) {
+        if (ct) { setMaximalMatchQuery4(lfg, r, l, *ct, Q, scratch, matches, hot); }
+        else { setMaximalMatchQuery3(lfg, r, l, Q, scratch, matches, hot); }
+        return;
+    }
+
+    virtualInsertionWithSuffLFGBWT(lfg, r, l, Q, scratch);
+    const gbwt::vector_type& Qs = scratch.Qs;
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s;
+    std::vector<gbwt::size_type>& lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    lcpa.resize(Qs.size());
+    lcpb.resize(Qs.size());
+    gbwt::size_type n = bounds.size() - 1;
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (gbwt::size_type t = 0; t < n; ++t) {
+        if (ct) { lcpAboveBelowCT(lfg, l, *ct, a, s, Qs, lcpa, lcpb, bounds[t], bounds[t+1]); }
+        else { lcpAboveBelowLFGBWT(lfg, a, Qs, lcpa, lcpb, bounds[t], bounds[t+1]); }
+    }
+
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> segmentMatches(n);
+    //segment buffers keep the filter of matches, see FilteredSink
+    auto filter = matchFilter(matches);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (gbwt::size_type t = 0; t < n; ++t) {
+        if (filter) {
+            auto sink = filterMatches(*filter, segmentMatches[t]);
+            setMaximalMatchSegmentLFGBWT(lfg, r, l, Q, a, s, lcpa, lcpb, bounds[t], bounds[t+1], sink, hot);
+        }
+        else { setMaximalMatchSegmentLFGBWT(lfg, r, l, Q, a, s, lcpa, lcpb, bounds[t], bounds[t+1], segmentMatches[t], hot); }
+    }
+    emitSegmentMatches(segmentMatches, matches, false);
+}
+
+//longMatchQuery3 (ct == nullptr) or longMatchQuery4 with the lcp and block phases split into segments, see querySegmentBounds
+template<class Sink>
+void longMatchQueryParallelLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::size_type L, const gbwt::vector_type& Q, const gbwt::size_type segments, 
+        QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    for (gbwt::node_type a : Q)
+        if (!lfg.contains(a) || lfg.nodeSize(a) == 0)
+            return;
+    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size()) { return; }
+    std::vector<gbwt::size_type> bounds = querySegmentBounds(Q.size() + 1, segments);
+    if (bounds.size() == 2) {
+        if (ct) { longMatchQuery4(lfg, r, l, *ct, L, Q, scratch, matches, hot); }
+        else { longMatchQuery3(lfg, r, l, L, Q, scratch, matches, hot); }
+        return;
+    }
+
+    virtualInsertionWithSuffLFGBWT(lfg, r, l, Q, scratch);
+    const gbwt::vector_type& Qs = scratch.Qs;
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s;
+    std::vector<gbwt::size_type>& lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    lcpa.resize(Qs.size());
+    lcpb.resize(Qs.size());
+    gbwt::size_type n = bounds.size() - 1;
+
+    //a segment only reads the lcps of its own range, so both phases run in one loop
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> segmentMatches(n);
+    auto filter = matchFilter(matches);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (gbwt::size_type t = 0; t < n; ++t) {
+        if (ct) { lcpAboveBelowCT(lfg, l, *ct, a, s, Qs, lcpa, lcpb, bounds[t], bounds[t+1]); }
+        else { lcpAboveBelowLFGBWT(lfg, a, Qs, lcpa, lcpb, bounds[t], bounds[t+1]); }
+        SuffixBlockMap inBlock;
+        if (filter) {
+            auto sink = filterMatches(*filter, segmentMatches[t]);
+            longMatchSegmentLFGBWT(lfg, r, l, L, Qs, a, s, lcpa, lcpb, bounds[t+1] - 1, bounds[t], inBlock, sink, hot);
+        }
+        else { longMatchSegmentLFGBWT(lfg, r, l, L, Qs, a, s, lcpa, lcpb, bounds[t+1] - 1, bounds[t], inBlock, segmentMatches[t], hot); }
+    }
+    emitSegmentMatches(segmentMatches, matches, true);
+}
+
+//(start position in Q, length, path ID, start position in path)
+//segments == 0 picks the number of segments from the query length and the number of threads
+template<class Sink>
+void setMaximalMatchQueryParallel3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q, const gbwt::size_type segments, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    setMaximalMatchQueryParallelLFGBWT(lfg, r, l, nullptr, Q, segments, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryParallel3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q, const gbwt::size_type segments = 0, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryParallel3(lfg, r, l, Q, segments, scratch, matches, hot);
+    return matches;
+}
+
+template<class Sink>
+void setMaximalMatchQueryParallel4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::vector_type& Q, const gbwt::size_type segments, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    setMaximalMatchQueryParallelLFGBWT(lfg, r, l, &ct, Q, segments, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryParallel4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::vector_type& Q, const gbwt::size_type segments = 0, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryParallel4(lfg, r, l, ct, Q, segments, scratch, matches, hot);
+    return matches;
+}
+
+template<class Sink>
+void longMatchQueryParallel3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q, const gbwt::size_type segments, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    longMatchQueryParallelLFGBWT(lfg, r, l, nullptr, L, Q, segments, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+longMatchQueryParallel3(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::size_type L, const gbwt::vector_type& Q, const gbwt::size_type segments = 0, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    longMatchQueryParallel3(lfg, r, l, L, Q, segments, scratch, matches, hot);
+    return matches;
+}
+
+template<class Sink>
+void longMatchQueryParallel4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q, const gbwt::size_type segments, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr) {
+    longMatchQueryParallelLFGBWT(lfg, r, l, &ct, L, Q, segments, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+longMatchQueryParallel4(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText& ct, const gbwt::size_type L, const gbwt::vector_type& Q, const gbwt::size_type segments = 0, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    longMatchQueryParallel4(lfg, r, l, ct, L, Q, segments, scratch, matches, hot);
+    return matches;
+}
+#endif //GBWT_QUERY_PARALLELQUERY_H
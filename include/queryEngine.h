@@ -0,0 +1,271 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_QUERYENGINE_H
+#define GBWT_QUERY_QUERYENGINE_H
+
+#include<setMaximalMatchQuery.h>
+#include<longMatchQuery.h>
+#include<vector>
+#include<memory>
+#include<mutex>
+#include<atomic>
+#include<unordered_map>
+
+//QueryEngine binds the indexes of one numbered query version and answers set maximal match
+//and long match queries with per-thread QueryScratch buffers that are reused across queries
+//The version is 2 (GBWT), 3 (lf gbwt), 4 (lf gbwt and CompText), or 2_4 (GBWT and CompText)
+//Queries may be issued concurrently from any threads (OpenMP teams, nested regions, or std::thread workers), a thread
+//gets its own scratch on its first query on the engine, see threadScratch
+//Consecutive queries on one thread reuse the virtual insertion of their common prefix, see sharedPrefixInsertion
+//A query with a node that is not in the index has no matches unless splitAtUnknownNodes is set, then each maximal
+//segment of known nodes is queried in the same call and matches are reported in the coordinates of Q, see forEachKnownSegment
+//With reportBothOrientations the matches on reverse paths are reported in forward path coordinates, so one query of Q
+//covers the matches of Q and of its reverse, see CanonicalOrientationSink
+//With leaveOut the queries are answered as if only the members of an ExcludedSequences (see excludingSequences) or a
+//HaplotypeFilter were in the index
+class QueryEngine{
+    public:
+    typedef gbwt::size_type size_type;
+    typedef std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type> match_type;
+
+    //version 2, or 2_4 if ct is given
+    //expectedBlockSize is the number of suffixes expected in a long match block, see SuffixBlockMap
+    QueryEngine(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct = nullptr, const HotNodeCache* hot = nullptr, size_type expectedBlockSize = 0);
+    //version 3, or 4 if ct is given
+    QueryEngine(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct = nullptr, const HotNodeCache* hot = nullptr, size_type expectedBlockSize = 0);
+
+    //writes the set maximal matches of Q to matches, a vector (appended to) or a callable, see emitMatch
+    template<class Sink>
+    void setMaximalMatches(const gbwt::vector_type& Q, Sink& matches);
+    //writes the long matches of length at least L of Q to matches, a vector (appended to) or a callable, see emitMatch
+    template<class Sink>
+    void longMatches(const gbwt::size_type L, const gbwt::vector_type& Q, Sink& matches);
+
+    //writes the set maximal matches of Q at least as long as the topK-th longest one, see addTopKSetMaximalMatches
+    template<class Sink>
+    void topKSetMaximalMatches(const gbwt::vector_type& Q, const gbwt::size_type topK, Sink& matches);
+
+    //as above, but results are written to a per-thread buffer that is valid until the next query on this thread
+    const std::vector<match_type>& setMaximalMatches(const gbwt::vector_type& Q);
+    const std::vector<match_type>& longMatches(const gbwt::size_type L, const gbwt::vector_type& Q);
+    const std::vector<match_type>& topKSetMaximalMatches(const gbwt::vector_type& Q, const gbwt::size_type topK);
+
+    //queries are split at nodes that are not in the index instead of having no matches
+    void splitAtUnknownNodes(bool split) { this->split = split; }
+    //matches on reverse paths are reported in forward path coordinates, see CanonicalOrientationSink
+    void reportBothOrientations(bool both) { this->both = both; }
+    //queries are answered as if only the members of remaining were in the index (nullptr for every sequence), see
+    //setMaximalMatchQueryExcluding2, long matches only depend on their own path so they are filtered to the members
+    //remaining must outlive the queries, top k queries are not supported with a remaining set
+    //Remaining is ExcludedSequences or HaplotypeFilter
+    template<class Remaining>
+    void leaveOut(const Remaining* remaining) {
+        this->leaveOut(nullptr);
+        this->remainingSlot(remaining) = remaining;
+    }
+    void leaveOut(std::nullptr_t) { this->remainingExcluded = nullptr; this->remainingFilter = nullptr; }
+
+    //allocates scratch for threads up to a total of n, so the first queries of that many threads do not allocate
+    void reserveThreads(size_type n);
+    //number of threads with scratch, reserved or used
+    size_type threadCapacity() const;
+
+    private:
+    const gbwt::GBWT* g = nullptr;
+    const lf_gbwt::GBWT* lfg = nullptr;
+    const gbwt::FastLocate* r;
+    const FastLCP* l;
+    const CompText* ct;
+    const HotNodeCache* hot;
+    bool split = false, both = false;
+    //at most one is set, see leaveOut
+    const ExcludedSequences* remainingExcluded = nullptr;
+    const HaplotypeFilter* remainingFilter = nullptr;
+
+    const ExcludedSequences*& remainingSlot(const ExcludedSequences*) { return this->remainingExcluded; }
+    const HaplotypeFilter*& remainingSlot(const HaplotypeFilter*) { return this->remainingFilter; }
+    bool leavesOut() const { return this->remainingExcluded || this->remainingFilter; }
+    //calls f(remaining) with the set of leaveOut, which must be set
+    template<class F>
+    void withRemaining(F f) {
+        if (this->remainingExcluded) { f(*this->remainingExcluded); }
+        else { f(*this->remainingFilter); }
+    }
+
+    struct ThreadScratch {
+        QueryScratch scratch;
+        std::vector<match_type> matches;
+    };
+    size_type expectedBlockSize;
+    //scratch of the threads, the first assigned of them are owned by a thread, the rest are reserved
+    std::vector<std::unique_ptr<ThreadScratch>> threads;
+    size_type assigned = 0;
+    mutable std::mutex threadsMutex;
+    //identifies the engine in the scratch of a thread, ids are never reused so the entries of a destroyed engine are never found
+    const size_type id;
+
+    static size_type nextId() {
+        static std::atomic<size_type> next{0};
+        return next++;
+    }
+
+    //the scratch of the calling thread, assigned on its first query on this engine and kept until the engine is destroyed.
+    //Threads are told apart by a thread_local map from engine id, not by omp_get_thread_num(), which repeats across
+    //std::threads and nested teams. A thread keeps one small entry per engine it queried
+    ThreadScratch& threadScratch() {
+        thread_local std::unordered_map<size_type, ThreadScratch*> own;
+        ThreadScratch*& mine = own[this->id];
+        if (!mine) {
+            std::lock_guard<std::mutex> lock(this->threadsMutex);
+            if (this->assigned == this->threads.size())
+                this->threads.emplace_back(new ThreadScratch{QueryScratch(this->expectedBlockSize, true), {}});
+            mine = this->threads[this->assigned++].get();
+        }
+        return *mine;
+    }
+
+    //runRemaining with matches written through a CanonicalOrientationSink if both
+    template<class Sink, class Query>
+    void run(const gbwt::vector_type& Q, Sink& matches, Query query) {
+        if (this->both) {
+            auto canonical = bothOrientations(*this->l, matches);
+            this->runRemaining(Q, canonical, query);
+        }
+        else { this->runRemaining(Q, matches, query); }
+    }
+
+    //runSegments with only the matches of members of remaining written if it is set
+    template<class Sink, class Query>
+    void runRemaining(const gbwt::vector_type& Q, Sink& matches, Query query) {
+        if (this->leavesOut()) {
+            this->withRemaining([&] (const auto& remaining) {
+                auto kept = filterMatches(remaining, matches);
+                this->runSegments(Q, kept, query);
+            });
+        }
+        else { this->runSegments(Q, matches, query); }
+    }
+
+    //calls query(Q, scratch, matches) with the scratch of this thread, once per known segment if split
+    template<class Sink, class Query>
+    void runSegments(const gbwt::vector_type& Q, Sink& matches, Query query) {
+        QueryScratch& scratch = this->threadScratch().scratch;
+        if (!this->split) { query(Q, scratch, matches); }
+        else if (this->g) { forEachKnownSegment(*this->g, Q, scratch, matches, query); }
+        else { forEachKnownSegment(*this->lfg, Q, scratch, matches, query); }
+    }
+};
+
+QueryEngine::QueryEngine(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const HotNodeCache* hot, size_type expectedBlockSize)
+    : g(&g), r(&r), l(&l), ct(ct), hot(hot), expectedBlockSize(expectedBlockSize), id(nextId()) {}
+
+QueryEngine::QueryEngine(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const HotNodeCache* hot, size_type expectedBlockSize)
+    : lfg(&lfg), r(&r), l(&l), ct(ct), hot(hot), expectedBlockSize(expectedBlockSize), id(nextId()) {}
+
+void QueryEngine::reserveThreads(size_type n) {
+    std::lock_guard<std::mutex> lock(this->threadsMutex);
+    while (this->threads.size() < n)
+        this->threads.emplace_back(new ThreadScratch{QueryScratch(this->expectedBlockSize, true), {}});
+}
+
+QueryEngine::size_type QueryEngine::threadCapacity() const {
+    std::lock_guard<std::mutex> lock(this->threadsMutex);
+    return this->threads.size();
+}
+
+template<class Sink>
+void QueryEngine::setMaximalMatches(const gbwt::vector_type& Q, Sink& matches) {
+    this->run(Q, matches, [this] (const gbwt::vector_type& Q, QueryScratch& scratch, auto& matches) {
+        if (this->leavesOut()) {
+            this->withRemaining([&] (const auto& remaining) {
+                if (this->g && this->ct) { setMaximalMatchQueryExcluding2_4(*this->g, *this->r, *this->l, *this->ct, Q, remaining, scratch, matches, this->hot); }
+                else if (this->g) { setMaximalMatchQueryExcluding2(*this->g, *this->r, *this->l, Q, remaining, scratch, matches, this->hot); }
+                else if (this->ct) { setMaximalMatchQueryExcluding4(*this->lfg, *this->r, *this->l, *this->ct, Q, remaining, scratch, matches, this->hot); }
+                else { setMaximalMatchQueryExcluding3(*this->lfg, *this->r, *this->l, Q, remaining, scratch, matches, this->hot); }
+            });
+        }
+        else if (this->g) {
+            if (this->ct) { setMaximalMatchQuery2_4(*this->g, *this->r, *this->l, *this->ct, Q, scratch, matches, this->hot); }
+            else { setMaximalMatchQuery2(*this->g, *this->r, *this->l, Q, scratch, matches, this->hot); }
+        }
+        else {
+            if (this->ct) { setMaximalMatchQuery4(*this->lfg, *this->r, *this->l, *this->ct, Q, scratch, matches, this->hot); }
+            else { setMaximalMatchQuery3(*this->lfg, *this->r, *this->l, Q, scratch, matches, this->hot); }
+        }
+    });
+}
+
+template<class Sink>
+void QueryEngine::longMatches(const gbwt::size_type L, const gbwt::vector_type& Q, Sink& matches) {
+    this->run(Q, matches, [this, L] (const gbwt::vector_type& Q, QueryScratch& scratch, auto& matches) {
+        if (this->g) {
+            if (this->ct) { longMatchQuery2_4(*this->g, *this->r, *this->l, *this->ct, L, Q, scratch, matches, this->hot); }
+            else { longMatchQuery2(*this->g, *this->r, *this->l, L, Q, scratch, matches, this->hot); }
+        }
+        else {
+            if (this->ct) { longMatchQuery4(*this->lfg, *this->r, *this->l, *this->ct, L, Q, scratch, matches, this->hot); }
+            else { longMatchQuery3(*this->lfg, *this->r, *this->l, L, Q, scratch, matches, this->hot); }
+        }
+    });
+}
+
+template<class Sink>
+void QueryEngine::topKSetMaximalMatches(const gbwt::vector_type& Q, const gbwt::size_type topK, Sink& matches) {
+    if (this->leavesOut()) { throw std::invalid_argument("QueryEngine: top k queries do not support leaving out sequences!"); }
+    this->run(Q, matches, [this, topK] (const gbwt::vector_type& Q, QueryScratch& scratch, auto& matches) {
+        if (this->g) {
+            if (this->ct) { setMaximalMatchQueryTopK2_4(*this->g, *this->r, *this->l, *this->ct, Q, topK, scratch, matches, this->hot); }
+            else { setMaximalMatchQueryTopK2(*this->g, *this->r, *this->l, Q, topK, scratch, matches, this->hot); }
+        }
+        else {
+            if (this->ct) { setMaximalMatchQueryTopK4(*this->lfg, *this->r, *this->l, *this->ct, Q, topK, scratch, matches, this->hot); }
+            else { setMaximalMatchQueryTopK3(*this->lfg, *this->r, *this->l, Q, topK, scratch, matches, this->hot); }
+        }
+    });
+}
+
+const std::vector<QueryEngine::match_type>& QueryEngine::setMaximalMatches(const gbwt::vector_type& Q) {
+    std::vector<match_type>& matches = this->threadScratch().matches;
+    matches.clear();
+    this->setMaximalMatches(Q, matches);
+    return matches;
+}
+
+const std::vector<QueryEngine::match_type>& QueryEngine::longMatches(const gbwt::size_type L, const gbwt::vector_type& Q) {
+    std::vector<match_type>& matches = this->threadScratch().matches;
+    matches.clear();
+    this->longMatches(L, Q, matches);
+    return matches;
+}
+
+const std::vector<QueryEngine::match_type>& QueryEngine::topKSetMaximalMatches(const gbwt::vector_type& Q, const gbwt::size_type topK) {
+    std::vector<match_type>& matches = this->threadScratch().matches;
+    matches.clear();
+    this->topKSetMaximalMatches(Q, topK, matches);
+    return matches;
+}
+
+#endif //GBWT_QUERY_QUERYENGINE_H
@@ -0,0 +1,251 @@
+/*
+MIT License
+
+Copyright (c) 2024 Ahsan Sanaullah
+Copyright (c) 2024 S. Zhang Lab at UCF
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GBWT_QUERY_QUERYPLANNER_H
+#define GBWT_QUERY_QUERYPLANNER_H
+
+#include<setMaximalMatchQuery.h>
+#include<longMatchQuery.h>
+#include<vector>
+#include<cmath>
+#include<stdexcept>
+
+//QueryPlanner picks the numbered version of each query among the versions whose indexes are loaded
+//Before calibrate the cost of a version is its work in LF steps, from index statistics and the query:
+//- the virtual insertion makes one LF step per node, decoding a GBWT record costs about its runs (runsPerNode) while the
+//  lf gbwt answers by rank and select (log of the runs)
+//- the lcps by inverseLF walks (2, 3) take one step per node above and below, plus a new walk wherever the neighbour
+//  changes (about once per run, runHeadRate of the rows) that repeats up to min(averageLCP, |Q|) steps, the lcps on the
+//  CompText (4, 2_4) take about two accesses per node above and below of ctDepth levels each. So walks win on short queries
+//  and indexes of short lcps and the CompText on long queries over long lcps
+//- long match blocks make another LF step per node on the index of the version, and expand while the block is not empty,
+//  which is about min(1, averageLCP / L) of the nodes
+//Locating the matches costs the same with every FastLCP version and is left out.
+//calibrate replaces the model of every version by a least squares fit of intercept + slope * |Q| to its measured times on
+//a sample of queries, so mixed workloads of short and long queries find the crossover between versions by query length.
+//Only the kinds that were timed are replaced, the others keep the model in LF steps
+//Version 1 locates every set maximal match by backward search (about one more LF step per node) and is only planned
+//for set maximal matches when the FastLCP is not loaded, version 0 reports no path positions and is never planned
+class QueryPlanner{
+    public:
+    typedef gbwt::size_type size_type;
+    typedef std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type> match_type;
+    enum Version { V1, V2, V3, V4, V2_4, VERSIONS };
+    //kinds of queries with separate cost models
+    enum Kind { SET_MAXIMAL, LONG, KINDS };
+
+    //indexes other than r may be nullptr, a version is only planned if all of its indexes are given
+    QueryPlanner(const gbwt::GBWT* g, const lf_gbwt::GBWT* lfg, const gbwt::FastLocate& r, const FastLCP* l = nullptr, const CompText* ct = nullptr, const HotNodeCache* hot = nullptr);
+
+    bool available(Version v, Kind kind) const;
+    //predicted cost of a query of length n (with threshold L for long matches), in seconds if kind is calibrated and in LF steps otherwise
+    double cost(Version v, Kind kind, size_type n, size_type L = 0) const;
+    //cheapest available version, throws if there is none
+    Version plan(Kind kind, const gbwt::vector_type& Q, size_type L = 0) const;
+
+    //writes the set maximal matches of Q to matches (a vector or callable, see emitMatch) with the planned version
+    template<class Sink>
+    void setMaximalMatches(const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches) const;
+    //writes the long matches of length at least L of Q to matches with the planned version
+    template<class Sink>
+    void longMatches(const size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches) const;
+    std::vector<match_type> setMaximalMatches(const gbwt::vector_type& Q) const;
+    std::vector<match_type> longMatches(const size_type L, const gbwt::vector_type& Q) const;
+
+    //times every available version on queries (set maximal matches, and long matches of length at least L if L != 0)
+    //and fits the cost models to the times, queries should be a small sample of the workload with mixed lengths
+    void calibrate(const std::vector<gbwt::vector_type>& queries, const size_type L = 0);
+    bool calibrated(Kind kind) const { return this->isCalibrated[kind]; }
+
+    //index statistics of the cost model
+    double runsPerNode() const { return this->runs; }
+    //fraction of the rows that start a run
+    double runHeadRate() const { return this->runHeads; }
+    //mean lcp at run heads, sampled from the FastLCP (0 if it is not loaded)
+    double averageLCP() const { return this->lcp; }
+    size_type ctDepth() const { return (this->ct)? this->ct->depth() : 0; }
+
+    static const char* name(Version v);
+
+    private:
+    const gbwt::GBWT* g;
+    const lf_gbwt::GBWT* lfg;
+    const gbwt::FastLocate* r;
+    const FastLCP* l;
+    const CompText* ct;
+    const HotNodeCache* hot;
+    double runs = 0, runHeads = 0, lcp = 0;
+    //LF steps of one step of the virtual insertion and of the lcps of each version
+    double insertionStep[VERSIONS], lcpStep[VERSIONS];
+    double intercept[VERSIONS][KINDS], slope[VERSIONS][KINDS];
+    //the kinds timed by calibrate
+    bool isCalibrated[KINDS] = {};
+
+    template<class Sink>
+    void run(Version v, Kind kind, const size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches) const;
+};
+
+QueryPlanner::QueryPlanner(const gbwt::GBWT* g, const lf_gbwt::GBWT* lfg, const gbwt::FastLocate& r, const FastLCP* l, const CompText* ct, const HotNodeCache* hot)
+    : g(g), lfg(lfg), r(&r), l(l), ct(ct), hot(hot) {
+    size_type nodes = (g)? g->effective() : (lfg)? lfg->effective() : 0, rows = (g)? g->size() : (lfg)? lfg->size() : 0;
+    this->runs = (nodes)? double(r.samples.size()) / nodes : 0;
+    this->runHeads = (rows)? std::min(1.0, double(r.samples.size()) / rows) : 0;
+    //at most 4096 evenly spaced run heads
+    if (l && l->samples_lcp.size()) {
+        size_type step = std::max<size_type>(1, l->samples_lcp.size() / 4096), count = 0;
+        double sum = 0;
+        for (size_type i = 0; i < l->samples_lcp.size(); i += step, ++count)
+            sum += l->samples_lcp[i];
+        this->lcp = sum / count;
+    }
+    double gbwtStep = 1 + this->runs, lfgStep = 1 + std::log2(1 + this->runs), ctStep = 4.0 * this->ctDepth();
+    double insertion[VERSIONS] = {gbwtStep, gbwtStep, lfgStep, lfgStep, gbwtStep},
+           lcps[VERSIONS] = {gbwtStep, gbwtStep, lfgStep, ctStep, ctStep};
+    for (unsigned v = 0; v < VERSIONS; ++v) {
+        this->insertionStep[v] = insertion[v];
+        this->lcpStep[v] = lcps[v];
+        this->intercept[v][SET_MAXIMAL] = this->intercept[v][LONG] = this->slope[v][SET_MAXIMAL] = this->slope[v][LONG] = 0;
+    }
+}
+
+double QueryPlanner::cost(Version v, Kind kind, size_type n, size_type L) const {
+    if (this->isCalibrated[kind]) { return this->intercept[v][kind] + this->slope[v][kind] * n; }
+    double perNode = this->insertionStep[v];
+    //walks of 1 and 2 decode the GBWT, of 3 the lf gbwt, the CompText is compared from the previous lcp so it has no restarts
+    if (v == V4 || v == V2_4) { perNode += this->lcpStep[v]; }
+    else { perNode += 2 * this->lcpStep[v] * (1 + this->runHeads * std::min<double>(this->lcp, n)); }
+    if (v == V1) { perNode += this->insertionStep[v]; }
+    if (kind == LONG) { perNode += this->insertionStep[v] * (1 + ((L == 0)? 1.0 : std::min(1.0, this->lcp / L))); }
+    return perNode * n;
+}
+
+bool QueryPlanner::available(Version v, Kind kind) const {
+    switch (v) {
+        case V1: return kind == SET_MAXIMAL && this->g && !this->l;
+        case V2: return this->g && this->l;
+        case V3: return this->lfg && this->l;
+        case V4: return this->lfg && this->l && this->ct;
+        case V2_4: return this->g && this->l && this->ct;
+        default: return false;
+    }
+}
+
+QueryPlanner::Version QueryPlanner::plan(Kind kind, const gbwt::vector_type& Q, size_type L) const {
+    Version best = VERSIONS;
+    for (unsigned v = 0; v < VERSIONS; ++v)
+        if (this->available(Version(v), kind) && (best == VERSIONS || this->cost(Version(v), kind, Q.size(), L) < this->cost(best, kind, Q.size(), L)))
+            best = Version(v);
+    if (best == VERSIONS) { throw std::invalid_argument("QueryPlanner: no query version has its indexes loaded!"); }
+    return best;
+}
+
+template<class Sink>
+void QueryPlanner::run(Version v, Kind kind, const size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches) const {
+    if (kind == LONG) {
+        switch (v) {
+            case V2: longMatchQuery2(*this->g, *this->r, *this->l, L, Q, scratch, matches, this->hot); break;
+            case V3: longMatchQuery3(*this->lfg, *this->r, *this->l, L, Q, scratch, matches, this->hot); break;
+            case V4: longMatchQuery4(*this->lfg, *this->r, *this->l, *this->ct, L, Q, scratch, matches, this->hot); break;
+            case V2_4: longMatchQuery2_4(*this->g, *this->r, *this->l, *this->ct, L, Q, scratch, matches, this->hot); break;
+            default: throw std::invalid_argument(std::string("QueryPlanner: no long match query for version ") + name(v) + "!");
+        }
+        return;
+    }
+    switch (v) {
+        case V1: 
+            for (const match_type& m : setMaximalMatchQuery1(*this->g, *this->r, Q))
+                emitMatch(matches, std::get<0>(m), std::get<1>(m), std::get<2>(m), std::get<3>(m));
+            break;
+        case V2: setMaximalMatchQuery2(*this->g, *this->r, *this->l, Q, scratch, matches, this->hot); break;
+        case V3: setMaximalMatchQuery3(*this->lfg, *this->r, *this->l, Q, scratch, matches, this->hot); break;
+        case V4: setMaximalMatchQuery4(*this->lfg, *this->r, *this->l, *this->ct, Q, scratch, matches, this->hot); break;
+        case V2_4: setMaximalMatchQuery2_4(*this->g, *this->r, *this->l, *this->ct, Q, scratch, matches, this->hot); break;
+        default: throw std::invalid_argument("QueryPlanner: invalid query version!");
+    }
+}
+
+template<class Sink>
+void QueryPlanner::setMaximalMatches(const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches) const {
+    this->run(this->plan(SET_MAXIMAL, Q), SET_MAXIMAL, 0, Q, scratch, matches);
+}
+
+template<class Sink>
+void QueryPlanner::longMatches(const size_type L, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches) const {
+    this->run(this->plan(LONG, Q, L), LONG, L, Q, scratch, matches);
+}
+
+std::vector<QueryPlanner::match_type> QueryPlanner::setMaximalMatches(const gbwt::vector_type& Q) const {
+    QueryScratch scratch;
+    std::vector<match_type> matches;
+    this->setMaximalMatches(Q, scratch, matches);
+    return matches;
+}
+
+std::vector<QueryPlanner::match_type> QueryPlanner::longMatches(const size_type L, const gbwt::vector_type& Q) const {
+    QueryScratch scratch;
+    std::vector<match_type> matches;
+    this->longMatches(L, Q, scratch, matches);
+    return matches;
+}
+
+void QueryPlanner::calibrate(const std::vector<gbwt::vector_type>& queries, const size_type L) {
+    if (queries.empty()) { return; }
+    QueryScratch scratch;
+    //matches are counted, not kept, so the times are of the queries only
+    size_type found = 0;
+    auto count = [&found] (size_type, size_type, size_type, size_type) { ++found; };
+    for (unsigned kind = 0; kind < KINDS; ++kind) {
+        if (kind == LONG && L == 0) { continue; }
+        for (unsigned v = 0; v < VERSIONS; ++v) {
+            if (!this->available(Version(v), Kind(kind))) { continue; }
+            //least squares fit of time = intercept + slope * |Q|
+            double n = queries.size(), sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+            for (const gbwt::vector_type& Q : queries) {
+                double start = gbwt::readTimer();
+                this->run(Version(v), Kind(kind), L, Q, scratch, count);
+                double time = gbwt::readTimer() - start, x = Q.size();
+                sumX += x; sumY += time; sumXX += x * x; sumXY += x * time;
+            }
+            double sxx = sumXX - sumX * sumX / n, b = (sxx > 0)? (sumXY - sumX * sumY / n) / sxx : 0;
+            //with one query length or a negative slope the cost is taken as proportional to |Q|
+            if (b <= 0) { this->intercept[v][kind] = 0; this->slope[v][kind] = (sumX > 0)? sumY / sumX : 0; }
+            else { this->intercept[v][kind] = std::max(0.0, (sumY - b * sumX) / n); this->slope[v][kind] = b; }
+        }
+        this->isCalibrated[kind] = true;
+    }
+}
+
+const char* QueryPlanner::name(Version v) {
+    switch (v) {
+        case V1: return "1";
+        case V2: return "2";
+        case V3: return "3";
+        case V4: return "4";
+        case V2_4: return "2_4";
+        default: return "invalid";
+    }
+}
+
+#endif //GBWT_QUERY_QUERYPLANNER_H
@@ -52,28 +52,360 @@ SOFTWARE.
 
 #include<vector>
 #include<map>
+#include<unordered_map>
 
 #include<gbwt/gbwt.h>
 #include<gbwt/fast_locate.h>
 #include"fast_lcp.h"
 #include"lf_gbwt.h"
 #include"compText.h"
+#include"hot_node_cache.h"
+#include"haplotypeFilter.h"
+
+//map from shifted suffix (suffix + |Qs| - position in Qs) to end of match in Qs for the suffixes
+//in the current long match block. Open addressing with linear probing and backward shift deletion,
+//so emplace/find/erase do not allocate and the table is reused between blocks and queries
+class SuffixBlockMap {
+    public:
+    typedef gbwt::size_type size_type;
+    typedef std::pair<size_type,size_type> value_type;
+    typedef value_type* iterator;
+
+    //expectedBlockSize is the number of suffixes the table holds without growing
+    explicit SuffixBlockMap(size_type expectedBlockSize = 0) { this->reserve(expectedBlockSize); }
+
+    void reserve(size_type n) {
+        size_type bits = 4;
+        while ((size_type(1) << bits) < 2*n) { ++bits; }
+        if ((size_type(1) << bits) > this->table.size()) { this->rehash(bits); }
+    }
+
+    std::pair<iterator,bool> emplace(size_type key, size_type value) {
+        assert(key != emptyKey());
+        if (2*(this->elements + 1) > this->table.size()) { this->rehash(this->bits + 1); }
+        size_type i = this->slot(key);
+        while (this->table[i].first != emptyKey()) {
+            if (this->table[i].first == key) { return {&this->table[i], false}; }
+            i = (i + 1) & this->mask;
+        }
+        this->table[i] = {key, value};
+        ++this->elements;
+        return {&this->table[i], true};
+    }
+
+    iterator find(size_type key) {
+        for (size_type i = this->slot(key); this->table[i].first != emptyKey(); i = (i + 1) & this->mask)
+            if (this->table[i].first == key) { return &this->table[i]; }
+        return this->end();
+    }
+
+    iterator end() { return nullptr; }
+
+    void erase(iterator it) {
+        size_type i = it - this->table.data(), j = i;
+        while (true) {
+            j = (j + 1) & this->mask;
+            if (this->table[j].first == emptyKey()) { break; }
+            size_type k = this->slot(this->table[j].first);
+            //the entry at j stays if its home slot k is cyclically in (i, j]
+            if ((i <= j)? (i < k && k <= j) : (i < k || k <= j)) { continue; }
+            this->table[i] = this->table[j];
+            i = j;
+        }
+        this->table[i].first = emptyKey();
+        --this->elements;
+    }
+
+    size_type size() const { return this->elements; }
+    bool empty() const { return this->elements == 0; }
+
+    //keeps the capacity
+    void clear() {
+        if (this->elements) {
+            for (value_type& v : this->table) { v.first = emptyKey(); }
+            this->elements = 0;
+        }
+    }
+
+    private:
+    std::vector<value_type> table;
+    size_type bits = 0, mask = 0, elements = 0;
+
+    static size_type emptyKey() { return gbwt::invalid_offset(); }
+    //Fibonacci hashing, suffixes of a block are often consecutive
+    size_type slot(size_type key) const { return (key * size_type(0x9E3779B97F4A7C15ULL)) >> (64 - this->bits); }
+
+    void rehash(size_type newBits) {
+        std::vector<value_type> old(size_type(1) << newBits, value_type(emptyKey(), 0));
+        old.swap(this->table);
+        this->bits = newBits;
+        this->mask = this->table.size() - 1;
+        this->elements = 0;
+        for (const value_type& v : old)
+            if (v.first != emptyKey())
+                this->emplace(v.first, v.second);
+    }
+};
+
+//buffers of one query, reused across queries so their capacity is only allocated once
+struct QueryScratch {
+    gbwt::vector_type Qs;
+    std::vector<gbwt::size_type> a, s, lcpa, lcpb;
+    //positions of Qs ranked by setMaximalMatchQueryTopK*
+    std::vector<gbwt::size_type> candidates;
+    //the current segment of known nodes, see forEachKnownSegment
+    gbwt::vector_type segment;
+    SuffixBlockMap inBlock;
+    //a[i] and s[i] only depend on Qs[i..], the positions of the common prefix of Q and the previous query
+    //on this scratch are kept by virtual insertion, so only set it if every query on this scratch uses the same indexes
+    bool sharePrefix;
+
+    //expectedBlockSize is the number of suffixes expected in a long match block
+    explicit QueryScratch(gbwt::size_type expectedBlockSize = 0, bool sharePrefix = false) : inBlock(expectedBlockSize), sharePrefix(sharePrefix) {}
+};
+
+//matches of versions 2, 3, 4, and 2_4 are written to a sink, either a vector of matches
+//or a callable taking (start position in Q, length, path ID, start position in path)
+//so callers can consume matches as they are found instead of materializing all of them
+template<class Sink>
+inline void emitMatch(Sink& sink, gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+    sink(start, len, path, pathStart);
+}
+
+inline void emitMatch(std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches, 
+        gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+    matches.emplace_back(start, len, path, pathStart);
+}
+
+//sink that only passes on matches on the members of filter
+//match reporting asks the sink for its filter (see matchFilter) and skips nodes, runs, and suffixes without members
+//before locating them, long match blocks then only keep members in inBlock, so one query must use one filter throughout
+//Filter is a HaplotypeFilter or any type with its contains, runHasMembers, runsHaveMembers, and nodeHasMembers, see ExcludedSequences
+template<class Sink, class Filter = HaplotypeFilter>
+struct FilteredSink {
+    const Filter& filter;
+    Sink& sink;
+
+    void operator()(gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+        if (this->filter.contains(path)) { emitMatch(this->sink, start, len, path, pathStart); }
+    }
+};
+
+template<class Filter, class Sink>
+FilteredSink<Sink, Filter> filterMatches(const Filter& filter, Sink& sink) { return {filter, sink}; }
+
+//filter of the matches written to a sink, nullptr if every match is reported
+template<class Sink>
+inline const HaplotypeFilter* matchFilter(const Sink&) { return nullptr; }
+
+template<class Sink, class Filter>
+inline const Filter* matchFilter(const FilteredSink<Sink, Filter>& sink) { return &sink.filter; }
+
+//sink that adds offset to the start positions in Q, so matches of a segment of Q are reported in the coordinates of Q
+template<class Sink>
+struct OffsetSink {
+    gbwt::size_type offset;
+    Sink& sink;
+
+    void operator()(gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+        emitMatch(this->sink, start + this->offset, len, path, pathStart);
+    }
+};
+
+template<class Sink>
+inline auto matchFilter(const OffsetSink<Sink>& sink) { return matchFilter(sink.sink); }
+
+//sink for querying both orientations of Q in one call. In a bidirectional GBWT the match of reverse(Q) (reversed node
+//order and orientation) at (start, len) on path p is the match of Q at (|Q|-start-len, len) on the reverse of p, so the
+//matches of Q already are the matches of both orientations, and querying reverse(Q) as well reports every hit twice.
+//The matches on reverse paths are written with the start in the forward orientation of the path, |p|-pathStart-len,
+//so every hit is in the coordinates of the forward path and the path ID keeps the relative orientation (Path::is_reverse)
+template<class Sink>
+struct CanonicalOrientationSink {
+    const FastLCP& l;
+    Sink& sink;
+
+    void operator()(gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+        if (gbwt::Path::is_reverse(path)) { pathStart = this->l.pathLength(path) - pathStart - len; }
+        emitMatch(this->sink, start, len, path, pathStart);
+    }
+};
+
+template<class Sink>
+CanonicalOrientationSink<Sink> bothOrientations(const FastLCP& l, Sink& sink) { return {l, sink}; }
+
+template<class Sink>
+inline auto matchFilter(const CanonicalOrientationSink<Sink>& sink) { return matchFilter(sink.sink); }
+
+//filter without members, stepping a long match block with it skips every run and suffix leaving the block
+struct NoSequences {
+    bool contains(gbwt::size_type) const { return false; }
+    template<class Samples> bool runHasMembers(const Samples&, gbwt::node_type, gbwt::size_type) const { return false; }
+    template<class Samples> bool runsHaveMembers(const Samples&, gbwt::node_type, gbwt::size_type, gbwt::size_type) const { return false; }
+    template<class Samples> bool nodeHasMembers(const Samples&, gbwt::node_type) const { return false; }
+};
+
+//sink of the count queries, its filter has no members so no match is located or written to it
+//and inBlock stays empty, only the suffixes at the edges of the block are located, see countBlockStep
+struct CountSink {
+    void operator()(gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type) {}
+};
+
+inline const NoSequences* matchFilter(const CountSink&) { static const NoSequences none; return &none; }
+
+//calls query(segment, scratch, sink) for each maximal segment of Q of nodes that are in g with at least one suffix,
+//sink writes to matches with start positions in Q. No path contains the other nodes, so no match crosses them
+//and the matches of the segments are the matches of Q. The segment is kept in scratch.segment
+template<class Index, class Sink, class Query>
+void forEachKnownSegment(const Index& g, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, Query query) {
+    auto known = [&g] (gbwt::node_type a) { return a != gbwt::ENDMARKER && g.contains(a) && g.nodeSize(a) != 0; };
+    for (gbwt::size_type start = 0, end; start < Q.size(); start = end) {
+        while (start < Q.size() && !known(Q[start])) { ++start; }
+        for (end = start; end < Q.size() && known(Q[end]); ++end) {}
+        if (start == end) { continue; }
+        scratch.segment.assign(Q.begin() + start, Q.begin() + end);
+        OffsetSink<Sink> sink{start, matches};
+        query(static_cast<const gbwt::vector_type&>(scratch.segment), scratch, sink);
+    }
+}
+
+//lcpa[k] and lcpb[k] of the rows above and below a[k] become the lcps of Qs[k..] with the nearest rows of members of
+//remaining in node Qs[k], 0 if there is none, as if the other sequences were not in the index. A set maximal match
+//query over these lcps writing to filterMatches(remaining, matches) then reports the set maximal matches among the
+//members only, the walks in AddMatches* pass over the rows of the others. Rows are located one at a time while
+//moving away from a[k], so the cost is the number of rows of left out sequences next to the insertion positions
+//Remaining is a HaplotypeFilter or any type with its contains(sequence) and nodeHasMembers(l, node)
+template<class Index, class Remaining>
+void leaveOutLcps(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const Remaining& remaining,
+        const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs,
+        std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb) {
+    //Qs[Qs.size()-1] is the endmarker, lcpa and lcpb are 0 there
+    for (gbwt::size_type k = 0; k + 1 < Qs.size(); ++k) {
+        gbwt::node_type node = Qs[k];
+        gbwt::size_type n = g.nodeSize(node);
+        if (!remaining.nodeHasMembers(l, node)) { lcpa[k] = lcpb[k] = 0; continue; }
+        if (a[k] != 0) {
+            gbwt::size_type row = a[k] - 1, suff = (a[k] == n)? l.locateLast(node) : l.locatePrev(s[k]);
+            while (!remaining.contains(r.seqId(suff))) {
+                if (row == 0) { lcpa[k] = 0; break; }
+                lcpa[k] = std::min(lcpa[k], l.LCP(suff));
+                --row;
+                suff = l.locatePrev(suff);
+            }
+        }
+        if (a[k] != n) {
+            gbwt::size_type row = a[k], suff = s[k];
+            while (!remaining.contains(r.seqId(suff))) {
+                if (++row == n) { lcpb[k] = 0; break; }
+                suff = r.locateNext(suff);
+                lcpb[k] = std::min(lcpb[k], l.LCP(suff));
+            }
+        }
+    }
+}
+
+//inBlock holds every suffix of block, or only the members of block if filtered
+template<class Filter>
+inline bool blockMapAgrees(const SuffixBlockMap& inBlock, const gbwt::range_type block, const Filter* filter) {
+    return (filter)? inBlock.size() <= gbwt::Range::length(block) : inBlock.size() == gbwt::Range::length(block);
+}
 
 std::vector<gbwt::vector_type> extractPaths(const gbwt::GBWT&);
 std::vector<gbwt::size_type> locate(const gbwt::GBWT&, const gbwt::SearchState&);
 gbwt::vector_type reverseAndAppendENDMARKER(const gbwt::vector_type&);
+void reverseAndAppendENDMARKER(const gbwt::vector_type&, gbwt::vector_type&);
 std::vector<gbwt::size_type> virtualInsertionGBWT(const gbwt::GBWT&, const gbwt::vector_type&);
+std::vector<gbwt::size_type> virtualInsertionLFGBWT(const lf_gbwt::GBWT&, const gbwt::vector_type&);
+gbwt::size_type LFToNode(const lf_gbwt::GBWT&, const gbwt::node_type, const gbwt::size_type, const gbwt::node_type);
+gbwt::size_type countOccurrences(const gbwt::GBWT&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type);
+gbwt::size_type countOccurrences(const lf_gbwt::GBWT&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type);
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> virtualInsertionWithSuffGBWT(const gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&);
+void virtualInsertionWithSuffGBWT(const gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> virtualInsertionWithSuffLFGBWT(const lf_gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP &, const gbwt::vector_type&);
+void virtualInsertionWithSuffLFGBWT(const lf_gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
+template<class Locate, class LCPs> std::pair<gbwt::size_type,gbwt::size_type> LFWithSuffGBWT(const gbwt::GBWT&, const Locate&, const LCPs&, const gbwt::size_type, const gbwt::size_type, const gbwt::node_type, const gbwt::node_type);
+template<class Locate, class LCPs> std::pair<gbwt::size_type,gbwt::size_type> LFWithSuffLFGBWT(const lf_gbwt::GBWT&, const Locate&, const LCPs&, const gbwt::size_type, const gbwt::size_type, const gbwt::node_type, const gbwt::node_type);
+template<class Locate> gbwt::size_type sharedPrefixInsertion(const Locate&, const gbwt::vector_type&, QueryScratch&);
+void virtualInsertionWithSuffGBWT(const gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, QueryScratch&);
+void virtualInsertionWithSuffLFGBWT(const lf_gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, QueryScratch&);
+template<class Index, class Locate, class LCPs> void virtualInsertionWithSuff(const Index&, const Locate&, const LCPs&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
+template<class Index, class Locate, class LCPs> void virtualInsertionWithSuff(const Index&, const Locate&, const LCPs&, const gbwt::vector_type&, QueryScratch&);
+std::pair<gbwt::edge_type,gbwt::edge_type> inverseLFPair(const gbwt::GBWT&, const gbwt::node_type, const gbwt::size_type, const gbwt::size_type);
+std::pair<gbwt::edge_type,gbwt::edge_type> inverseLFPair(const lf_gbwt::GBWT&, const gbwt::node_type, const gbwt::size_type, const gbwt::size_type);
+template<class Index> std::pair<gbwt::size_type,gbwt::size_type> lcpAboveBelowWalk(const Index&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, const gbwt::size_type, bool, bool, gbwt::size_type&, gbwt::size_type&);
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> lcpAboveBelowGBWT(const gbwt::GBWT&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&);
+void lcpAboveBelowGBWT(const gbwt::GBWT&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> lcpAboveBelowLFGBWT(const lf_gbwt::GBWT&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&);
+void lcpAboveBelowLFGBWT(const lf_gbwt::GBWT&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
+void lcpAboveBelowLFGBWT(const lf_gbwt::GBWT&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&, const gbwt::size_type, const gbwt::size_type);
+template<class Index> void lcpAboveBelow(const Index&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
+template<class Index> void lcpAboveBelow(const Index&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&, const gbwt::size_type, const gbwt::size_type);
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> lcpAboveBelowCT(const lf_gbwt::GBWT&, const FastLCP&, const CompText&, const std::vector<gbwt::size_type>&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&);
+void lcpAboveBelowCT(const lf_gbwt::GBWT&, const FastLCP&, const CompText&, const std::vector<gbwt::size_type>&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
+template<class Index> void lcpAboveBelowCT(const Index&, const FastLCP&, const CompText&, const std::vector<gbwt::size_type>&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&, const gbwt::size_type, const gbwt::size_type);
+void lcpAboveBelowCT(const gbwt::GBWT&, const FastLCP&, const CompText&, const std::vector<gbwt::size_type>&, const std::vector<gbwt::size_type>&, const gbwt::vector_type&, std::vector<gbwt::size_type>&, std::vector<gbwt::size_type>&);
+template<class Index> void queryLcps(const Index&, const FastLCP&, const CompText*, QueryScratch&);
+template<class Index, class LCPs> void queryLcps(const Index&, const LCPs&, const CompText*, QueryScratch&);
 void AddMatchesGBWT(const gbwt::GBWT&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>&);
 gbwt::size_type endmarkerSampleFastLocate(const gbwt::FastLocate&, gbwt::size_type);
 void AddMatchesFastLocate(const gbwt::GBWT&, const gbwt::FastLocate&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>&);
+void AddMatchesFastLocate(const gbwt::GBWT&, const gbwt::FastLocate&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>&, std::unordered_map<gbwt::size_type,gbwt::size_type>&);
 gbwt::size_type endmarkerSampleFastLCP(const FastLCP&, gbwt::size_type);
-void AddMatchesFastLCP(const gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>&);
-void AddMatchesFastLCPLFGBWT(const lf_gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>&);
+template<class Index, class Locate, class LCPs, class Sink> void AddMatchesFastLCP(const Index&, const Locate&, const LCPs&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, Sink&, const HotNodeCache* = nullptr);
+template<class Sink> void AddMatchesFastLCPLFGBWT(const lf_gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, const gbwt::vector_type&, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, gbwt::size_type, Sink&, const HotNodeCache* = nullptr);
+template<class Sink, class QsType> std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type> AddLongMatchesFastLCP(const gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, SuffixBlockMap&, const gbwt::size_type, 
+        const QsType&, const gbwt::range_type, const gbwt::size_type, const gbwt::size_type, Sink&, const HotNodeCache* = nullptr);
+template<class Sink, class QsType> std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type> AddLongMatchesLFGBWT(const lf_gbwt::GBWT&, const gbwt::FastLocate&, const FastLCP&, SuffixBlockMap&, const gbwt::size_type, 
+        const QsType&, const gbwt::range_type, const gbwt::size_type, const gbwt::size_type, Sink&, const HotNodeCache* = nullptr);
+
+//------------------------------------------------------------------------------
+//Index traits
+
+//the primitives of the queries that depend on the index, IndexTraits<Index> is resolved at compile time so the templated
+//routines (virtualInsertionWithSuff, lcpAboveBelow, lcpAboveBelowCT, AddMatchesFastLCP) and queries (setMaximalMatchQueryT,
+//longMatchQueryT, ...) inline them, the numbered query versions are instantiations of these for gbwt::GBWT and lf_gbwt::GBWT.
+//Besides its traits an index has the members contains(node), nodeSize(node), bidirectional(), sequences(), and inverseLF(edge),
+//so a new index backend specializes IndexTraits and gets every query without a copy of it
+template<class Index> struct IndexTraits;
+
+template<>
+struct IndexTraits<gbwt::GBWT> {
+    //one step of virtual insertion, see LFWithSuffGBWT
+    template<class Locate, class LCPs>
+    static std::pair<gbwt::size_type,gbwt::size_type> LFWithSuff(const gbwt::GBWT& g, const Locate& r, const LCPs& l, 
+            const gbwt::size_type prevPos, const gbwt::size_type prevSuff, const gbwt::node_type from, const gbwt::node_type to) {
+        return LFWithSuffGBWT(g, r, l, prevPos, prevSuff, from, to);
+    }
+    static std::pair<gbwt::edge_type,gbwt::edge_type> inverseLFPair(const gbwt::GBWT& g, const gbwt::node_type from, const gbwt::size_type i, const gbwt::size_type j) {
+        return ::inverseLFPair(g, from, i, j);
+    }
+    //one step of a long match query, see AddLongMatchesFastLCP
+    template<class Sink, class QsType>
+    static std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type> AddLongMatches(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, 
+            const gbwt::size_type currQsInd, const QsType& Qs, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, Sink& matches, const HotNodeCache* hot) {
+        return AddLongMatchesFastLCP(g, r, l, inBlock, currQsInd, Qs, block, topSuff, botSuff, matches, hot);
+    }
+};
+
+template<>
+struct IndexTraits<lf_gbwt::GBWT> {
+    //one step of virtual insertion, see LFWithSuffLFGBWT
+    template<class Locate, class LCPs>
+    static std::pair<gbwt::size_type,gbwt::size_type> LFWithSuff(const lf_gbwt::GBWT& g, const Locate& r, const LCPs& l, 
+            const gbwt::size_type prevPos, const gbwt::size_type prevSuff, const gbwt::node_type from, const gbwt::node_type to) {
+        return LFWithSuffLFGBWT(g, r, l, prevPos, prevSuff, from, to);
+    }
+    static std::pair<gbwt::edge_type,gbwt::edge_type> inverseLFPair(const lf_gbwt::GBWT& g, const gbwt::node_type from, const gbwt::size_type i, const gbwt::size_type j) {
+        return g.inverseLF(from, i, j);
+    }
+    //one step of a long match query, see AddLongMatchesLFGBWT
+    template<class Sink, class QsType>
+    static std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type> AddLongMatches(const lf_gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, 
+            const gbwt::size_type currQsInd, const QsType& Qs, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, Sink& matches, const HotNodeCache* hot) {
+        return AddLongMatchesLFGBWT(g, r, l, inBlock, currQsInd, Qs, block, topSuff, botSuff, matches, hot);
+    }
+};
+//------------------------------------------------------------------------------
 
 std::vector<gbwt::vector_type>
 extractPaths(const gbwt::GBWT & x){
@@ -154,6 +486,12 @@ gbwt::vector_type reverseAndAppendENDMARKER(const gbwt::vector_type & Q) {
     return Qs;
 }
 
+//writes reverseAndAppendENDMARKER(Q) to Qs, reusing the capacity of Qs
+void reverseAndAppendENDMARKER(const gbwt::vector_type & Q, gbwt::vector_type & Qs) {
+    Qs.assign(Q.rbegin(), Q.rend());
+    Qs.push_back(gbwt::ENDMARKER);
+}
+
 //returns vector a where (Q[i], a[i]) is the virtual insertion position of the i-th suffix of Qs (Qs[i,Qs.size()-1])
 //assumes Qs.back() = gbwt::ENDMARKER
 std::vector<gbwt::size_type> virtualInsertionGBWT(const gbwt::GBWT& g, const gbwt::vector_type& Qs) {
@@ -168,249 +506,381 @@ std::vector<gbwt::size_type> virtualInsertionGBWT(const gbwt::GBWT& g, const gbw
     return a;
 }
 
+//number of positions before i in the record of from that continue to to, mapped to the record of to, invalid_offset() if from has no edge to to
+gbwt::size_type LFToNode(const lf_gbwt::GBWT& lfg, const gbwt::node_type from, const gbwt::size_type i, const gbwt::node_type to) {
+    auto ind = lfg.isSmallAndIndex(lfg.toComp(from));
+    gbwt::comp_type compTo = lfg.toComp(to);
+    if (ind.first) {
+        if (lfg.smallRecords.edgeTo(ind.second, compTo) >= lfg.smallRecords.outdegree(ind.second)) { return gbwt::invalid_offset(); }
+        return lfg.smallRecords.LF(ind.second, i, compTo);
+    }
+    const lf_gbwt::CompressedRecord& rec = lfg.largeRecords[ind.second];
+    if (rec.edgeTo(compTo) >= rec.outdegree()) { return gbwt::invalid_offset(); }
+    return rec.LF(i, compTo);
+}
+
+//virtualInsertionGBWT on the lf gbwt
+std::vector<gbwt::size_type> virtualInsertionLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::vector_type& Qs) {
+    std::vector<gbwt::size_type> a (Qs.size());
+    gbwt::size_type pos;
+    a.back() = 0;
+    for (gbwt::size_type i = Qs.size() - 1; i != 0; --i) {
+        pos = LFToNode(lfg, Qs[i], a[i], Qs[i-1]);
+        a[i-1] = (pos == gbwt::invalid_offset())? 0 : pos;
+    }
+    return a;
+}
+
+//number of occurrences of Q[start, end) in the paths, the size of its BWT block, by forward search without locating
+//assumes start < end and the nodes of Q are in the index
+gbwt::size_type countOccurrences(const gbwt::GBWT& g, const gbwt::vector_type& Q, gbwt::size_type start, gbwt::size_type end) {
+    gbwt::SearchState state = g.find(Q[start]);
+    for (gbwt::size_type i = start + 1; i < end && !state.empty(); ++i)
+        state = g.extend(state, Q[i]);
+    return state.size();
+}
+
+gbwt::size_type countOccurrences(const lf_gbwt::GBWT& lfg, const gbwt::vector_type& Q, gbwt::size_type start, gbwt::size_type end) {
+    gbwt::range_type range = {0, lfg.nodeSize(Q[start]) - 1};
+    for (gbwt::size_type i = start + 1; i < end && !gbwt::Range::empty(range); ++i) {
+        gbwt::size_type first = LFToNode(lfg, Q[i-1], range.first, Q[i]);
+        if (first == gbwt::invalid_offset()) { return 0; }
+        range = {first, LFToNode(lfg, Q[i-1], range.second + 1, Q[i]) - 1};
+    }
+    return gbwt::Range::length(range);
+}
+
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>>
 virtualInsertionWithSuffGBWT(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Qs) {
-    auto LFWithSuff = 
-        [&g, &r, &l] (const gbwt::size_type prevPos, const gbwt::size_type prevSuff, const gbwt::node_type from, const gbwt::node_type to) -> std::pair<gbwt::size_type,gbwt::size_type> {
-            //std::cout << "In LFWithSuff( prevPos: " << prevPos << ", prevSuff: " << prevSuff << ", from: " << from << ", to: " << to << ")" << std::endl;
-            gbwt::CompressedRecord rec = g.record(from);
+    std::vector<gbwt::size_type> a, s;
+    virtualInsertionWithSuffGBWT(g, r, l, Qs, a, s);
+    return {a, s};
+}
 
-            gbwt::size_type outrank = rec.edgeTo(to);
-            if (outrank >= rec.outdegree())
-                return {0, r.locateFirst(to)};
+//one step of virtual insertion: the position and suffix below of the query at from are mapped to to
+template<class Locate, class LCPs>
+std::pair<gbwt::size_type,gbwt::size_type>
+LFWithSuffGBWT(const gbwt::GBWT& g, const Locate& r, const LCPs& l, const gbwt::size_type prevPos, const gbwt::size_type prevSuff, const gbwt::node_type from, const gbwt::node_type to) {
+    //std::cout << "In LFWithSuff( prevPos: " << prevPos << ", prevSuff: " << prevSuff << ", from: " << from << ", to: " << to << ")" << std::endl;
+    gbwt::CompressedRecord rec = g.record(from);
 
-            gbwt::CompressedRecordRankIterator iter(rec, outrank); 
-            gbwt::size_type last_run_before = gbwt::invalid_offset();
+    gbwt::size_type outrank = rec.edgeTo(to);
+    if (outrank >= rec.outdegree())
+        return {0, r.locateFirst(to)};
 
-            if(iter->first == outrank) { last_run_before = iter.runId(); }
-            while(!(iter.end()) && iter.offset() < prevPos)
-            {
-                ++iter;
-                if(iter->first == outrank)
-                    last_run_before = iter.runId();
-            }
+    gbwt::CompressedRecordRankIterator iter(rec, outrank); 
+    gbwt::size_type last_run_before = gbwt::invalid_offset();
 
-            gbwt::size_type temp = iter.rank();
-            if (prevPos < iter.offset() && iter->first == outrank)
-                return {temp - (iter.offset() - prevPos), prevSuff - 1};
-            
-            if (last_run_before != gbwt::invalid_offset())
-                return {temp, 
-                    ((temp == g.nodeSize(to))? 
-                     gbwt::invalid_offset() : 
-                     r.locateNext(l.getSampleBot(from, last_run_before)-1))};
-
-            while (iter->first != outrank)
-                ++iter;
-            return {temp, l.getSample(from, iter.runId())-1};
-        };
-    std::vector<gbwt::size_type> a(Qs.size());
-    std::vector<gbwt::size_type> s(Qs.size());
-    a.shrink_to_fit();
-    s.shrink_to_fit();
-    a.back() = 0;
-    s.back() = r.locateFirst(gbwt::ENDMARKER);
-    for (gbwt::size_type i = Qs.size() - 1; i != 0; --i)
-        std::tie(a[i-1], s[i-1]) = LFWithSuff(a[i], s[i], Qs[i], Qs[i-1]);
-    return {a, s};
+    if(iter->first == outrank) { last_run_before = iter.runId(); }
+    while(!(iter.end()) && iter.offset() < prevPos)
+    {
+        ++iter;
+        if(iter->first == outrank)
+            last_run_before = iter.runId();
+    }
+
+    gbwt::size_type temp = iter.rank();
+    if (prevPos < iter.offset() && iter->first == outrank)
+        return {temp - (iter.offset() - prevPos), prevSuff - 1};
+    
+    if (last_run_before != gbwt::invalid_offset())
+        return {temp, 
+            ((temp == g.nodeSize(to))? 
+             gbwt::invalid_offset() : 
+             r.locateNext(l.getSampleBot(from, last_run_before)-1))};
+
+    while (iter->first != outrank)
+        ++iter;
+    return {temp, l.getSample(from, iter.runId())-1};
+}
+
+void virtualInsertionWithSuffGBWT(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& a, std::vector<gbwt::size_type>& s) {
+    virtualInsertionWithSuff(g, r, l, Qs, a, s);
 }
 
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>>
 virtualInsertionWithSuffLFGBWT(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate& r, const FastLCP & l, const gbwt::vector_type& Qs) {
-    auto LFWithSuff = 
-        [&lfg, &r, &l] (const gbwt::size_type prevPos, const gbwt::size_type prevSuff, const gbwt::node_type from, const gbwt::node_type to) -> std::pair<gbwt::size_type,gbwt::size_type> {
-            //std::cout << "In LFWithSuffLFGBWT( prevPos: " << prevPos << ", prevSuff: " << prevSuff << ", from: " << from << ", to: " << to << ")" << std::endl;
-            auto ind = lfg.isSmallAndIndex(lfg.toComp(from));
-            gbwt::comp_type compTo= lfg.toComp(to);
-            //std::cout << "compTo: " << compTo << " ind: (" << ind.first << ", " << ind.second << ")" << std::endl;
-            if (ind.first) {
-                auto t = lfg.smallRecords.emptyAndNonEmptyIndex(ind.second);
-                assert(!t.first); //since for every node in the query, there must be a path that contains it in the GBWT
-                gbwt::size_type outrank = lfg.smallRecords.edgeTo(ind.second, compTo),
-                    newPos = lfg.smallRecords.LF(ind.second, prevPos, compTo);
-                //std::cout << "outrank " << outrank << " newPos " << newPos << std::endl;
-                if (outrank >= lfg.smallRecords.outdegree(ind.second))
-                    return {0, r.locateFirst(to)};
-                //std::cout << "outrank not out of bounds" << std::endl;
-
-                if (prevPos < lfg.smallRecords.size(ind.second) && lfg.smallRecords.bwtAt(ind.second, prevPos) == compTo)
-                    return {newPos, prevSuff - 1};
-                //std::cout << "prevPos bwt not equal to compTo" << std::endl;
-
-                gbwt::size_type prefixLength = lfg.smallRecords.prefixSum.select_iter(t.second + 1)->second;
-                auto nextRun = lfg.smallRecords.firstByAlphabet.successor(prefixLength*lfg.smallRecords.maxOutdegree + outrank* lfg.smallRecords.size(ind.second) + prevPos);
-                if (nextRun->second - prefixLength*lfg.smallRecords.maxOutdegree < (outrank+1)*lfg.smallRecords.size(ind.second)) {
-                    //successor run exists
-                    //std::cout << "successor run exists" << std::endl;
-                    gbwt::size_type run_id = lfg.smallRecords.logicalRunId(ind.second, nextRun->second - prefixLength*lfg.smallRecords.maxOutdegree - outrank*lfg.smallRecords.size(ind.second));
-                    return {newPos, l.getSample(from, run_id) - 1};
-                }
-                else if (newPos < lfg.nodeSize(to)) {
-                    //predecessor run exists
-                    auto prevRun = --nextRun;
-                    gbwt::size_type run_id = lfg.smallRecords.logicalRunId(ind.second, prevRun->second - prefixLength*lfg.smallRecords.maxOutdegree - outrank*lfg.smallRecords.size(ind.second));
-                    return {newPos, r.locateNext(l.getSampleBot(from, run_id) - 1)};
-                }
-                return {newPos, gbwt::invalid_offset()};
-            }
-            else {
-                const lf_gbwt::CompressedRecord& rec = lfg.largeRecords[ind.second];
-
-                gbwt::size_type outrank = rec.edgeTo(compTo),
-                    newPos = rec.LF(prevPos, compTo);
-                if (outrank >= rec.outdegree())
-                    return {0, r.locateFirst(to)};
-
-                if (prevPos < rec.size() && rec[prevPos] == compTo)
-                    return {newPos, prevSuff - 1};
-
-                auto nextRun = rec.firstByAlphabet.successor(outrank*rec.size() + prevPos);
-                if (nextRun->second < (outrank+1)*rec.size()){
-                    //successor run exists
-                    gbwt::size_type run_id = rec.logicalRunId(nextRun->second-outrank*rec.size());
-                    return {newPos, l.getSample(from, run_id) - 1};
-                }
-                else if (newPos < lfg.nodeSize(to)){
-                    //predecessor run exists
-                    auto prevRun = --nextRun;
-                    gbwt::size_type run_id = rec.logicalRunId(prevRun->second - outrank*rec.size());
-                    return {newPos, r.locateNext(l.getSampleBot(from, run_id) - 1)};
-                }
-                //predecessor run exists but newPos == lfg.record(to).size
-                return {newPos, gbwt::invalid_offset()};
-            }
-        };
-    std::vector<gbwt::size_type> a(Qs.size());
-    std::vector<gbwt::size_type> s(Qs.size());
-    a.shrink_to_fit();
-    s.shrink_to_fit();
+    std::vector<gbwt::size_type> a, s;
+    virtualInsertionWithSuffLFGBWT(lfg, r, l, Qs, a, s);
+    return {a, s};
+}
+
+//one step of virtual insertion: the position and suffix below of the query at from are mapped to to
+template<class Locate, class LCPs>
+std::pair<gbwt::size_type,gbwt::size_type>
+LFWithSuffLFGBWT(const lf_gbwt::GBWT& lfg, const Locate& r, const LCPs& l, const gbwt::size_type prevPos, const gbwt::size_type prevSuff, const gbwt::node_type from, const gbwt::node_type to) {
+    //std::cout << "In LFWithSuffLFGBWT( prevPos: " << prevPos << ", prevSuff: " << prevSuff << ", from: " << from << ", to: " << to << ")" << std::endl;
+    auto ind = lfg.isSmallAndIndex(lfg.toComp(from));
+    gbwt::comp_type compTo= lfg.toComp(to);
+    //std::cout << "compTo: " << compTo << " ind: (" << ind.first << ", " << ind.second << ")" << std::endl;
+    if (ind.first) {
+        auto t = lfg.smallRecords.emptyAndNonEmptyIndex(ind.second);
+        assert(!t.first); //since for every node in the query, there must be a path that contains it in the GBWT
+        gbwt::size_type outrank = lfg.smallRecords.edgeTo(ind.second, compTo),
+            newPos = lfg.smallRecords.LF(ind.second, prevPos, compTo);
+        //std::cout << "outrank " << outrank << " newPos " << newPos << std::endl;
+        if (outrank >= lfg.smallRecords.outdegree(ind.second))
+            return {0, r.locateFirst(to)};
+        //std::cout << "outrank not out of bounds" << std::endl;
+
+        if (prevPos < lfg.smallRecords.size(ind.second) && lfg.smallRecords.bwtAt(ind.second, prevPos) == compTo)
+            return {newPos, prevSuff - 1};
+        //std::cout << "prevPos bwt not equal to compTo" << std::endl;
+
+        gbwt::size_type prefixLength = lfg.smallRecords.prefixSum.select_iter(t.second + 1)->second;
+        auto nextRun = lfg.smallRecords.firstByAlphabet.successor(prefixLength*lfg.smallRecords.maxOutdegree + outrank* lfg.smallRecords.size(ind.second) + prevPos);
+        if (nextRun->second - prefixLength*lfg.smallRecords.maxOutdegree < (outrank+1)*lfg.smallRecords.size(ind.second)) {
+            //successor run exists
+            //std::cout << "successor run exists" << std::endl;
+            gbwt::size_type run_id = lfg.smallRecords.logicalRunId(ind.second, nextRun->second - prefixLength*lfg.smallRecords.maxOutdegree - outrank*lfg.smallRecords.size(ind.second));
+            return {newPos, l.getSample(from, run_id) - 1};
+        }
+        else if (newPos < lfg.nodeSize(to)) {
+            //predecessor run exists
+            auto prevRun = --nextRun;
+            gbwt::size_type run_id = lfg.smallRecords.logicalRunId(ind.second, prevRun->second - prefixLength*lfg.smallRecords.maxOutdegree - outrank*lfg.smallRecords.size(ind.second));
+            return {newPos, r.locateNext(l.getSampleBot(from, run_id) - 1)};
+        }
+        return {newPos, gbwt::invalid_offset()};
+    }
+    else {
+        const lf_gbwt::CompressedRecord& rec = lfg.largeRecords[ind.second];
+
+        gbwt::size_type outrank = rec.edgeTo(compTo),
+            newPos = rec.LF(prevPos, compTo);
+        if (outrank >= rec.outdegree())
+            return {0, r.locateFirst(to)};
+
+        if (prevPos < rec.size() && rec[prevPos] == compTo)
+            return {newPos, prevSuff - 1};
+
+        auto nextRun = rec.firstByAlphabet.successor(outrank*rec.size() + prevPos);
+        if (nextRun->second < (outrank+1)*rec.size()){
+            //successor run exists
+            gbwt::size_type run_id = rec.logicalRunId(nextRun->second-outrank*rec.size());
+            return {newPos, l.getSample(from, run_id) - 1};
+        }
+        else if (newPos < lfg.nodeSize(to)){
+            //predecessor run exists
+            auto prevRun = --nextRun;
+            gbwt::size_type run_id = rec.logicalRunId(prevRun->second - outrank*rec.size());
+            return {newPos, r.locateNext(l.getSampleBot(from, run_id) - 1)};
+        }
+        //predecessor run exists but newPos == lfg.record(to).size
+        return {newPos, gbwt::invalid_offset()};
+    }
+}
+
+void virtualInsertionWithSuffLFGBWT(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate& r, const FastLCP & l, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& a, std::vector<gbwt::size_type>& s) {
+    virtualInsertionWithSuff(lfg, r, l, Qs, a, s);
+}
+
+//virtual insertion positions a and suffixes below s of Qs on any index, see IndexTraits
+template<class Index, class Locate, class LCPs>
+void virtualInsertionWithSuff(const Index& g, const Locate& r, const LCPs& l, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& a, std::vector<gbwt::size_type>& s) {
+    a.resize(Qs.size());
+    s.resize(Qs.size());
     a.back() = 0;
     s.back() = r.locateFirst(gbwt::ENDMARKER);
     for (gbwt::size_type i = Qs.size() - 1; i != 0; --i)
-        std::tie(a[i-1], s[i-1]) = LFWithSuff(a[i], s[i], Qs[i], Qs[i-1]);
-    return {a, s};
+        std::tie(a[i-1], s[i-1]) = IndexTraits<Index>::LFWithSuff(g, r, l, a[i], s[i], Qs[i], Qs[i-1]);
+}
+
+//sets scratch.Qs to reverse(Q) + ENDMARKER and keeps the virtual insertion positions of the longest common prefix
+//of Q and the previous query on scratch if scratch.sharePrefix is set, the kept positions are moved to the end of a and s
+//returns the number of valid positions at the end of a and s, at least 1 for the ENDMARKER
+//queries run in lexicographic order on one scratch perform each LF step once per edge of the trie of the queries
+template<class Locate>
+gbwt::size_type sharedPrefixInsertion(const Locate& r, const gbwt::vector_type& Q, QueryScratch& scratch) {
+    gbwt::vector_type& Qs = scratch.Qs;
+    std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s;
+    gbwt::size_type shared = 0, prevSize = Qs.size(), size = Q.size() + 1;
+    if (scratch.sharePrefix && prevSize != 0 && a.size() == prevSize && s.size() == prevSize) {
+        //Qs[prevSize-2-i] is the ith node of the previous query
+        while (shared < prevSize - 1 && shared < Q.size() && Q[shared] == Qs[prevSize - 2 - shared])
+            ++shared;
+    }
+    if (shared == 0) {
+        a.resize(size);
+        s.resize(size);
+    }
+    else if (size > prevSize) {
+        a.resize(size);
+        s.resize(size);
+        std::move_backward(a.begin() + (prevSize - shared - 1), a.begin() + prevSize, a.end());
+        std::move_backward(s.begin() + (prevSize - shared - 1), s.begin() + prevSize, s.end());
+    }
+    else if (size < prevSize) {
+        std::move(a.begin() + (prevSize - shared - 1), a.end(), a.begin() + (size - shared - 1));
+        std::move(s.begin() + (prevSize - shared - 1), s.end(), s.begin() + (size - shared - 1));
+        a.resize(size);
+        s.resize(size);
+    }
+    a.back() = 0;
+    s.back() = r.locateFirst(gbwt::ENDMARKER);
+    reverseAndAppendENDMARKER(Q, Qs);
+    return shared + 1;
+}
+
+//virtual insertion of Q with the buffers of scratch, Qs, a, and s are written to scratch, see sharedPrefixInsertion
+template<class Index, class Locate, class LCPs>
+void virtualInsertionWithSuff(const Index& g, const Locate& r, const LCPs& l, const gbwt::vector_type& Q, QueryScratch& scratch) {
+    gbwt::size_type valid = sharedPrefixInsertion(r, Q, scratch);
+    const gbwt::vector_type& Qs = scratch.Qs;
+    std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s;
+    for (gbwt::size_type i = Qs.size() - valid; i != 0; --i)
+        std::tie(a[i-1], s[i-1]) = IndexTraits<Index>::LFWithSuff(g, r, l, a[i], s[i], Qs[i], Qs[i-1]);
+}
+
+void virtualInsertionWithSuffGBWT(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q, QueryScratch& scratch) {
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+}
+
+void virtualInsertionWithSuffLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q, QueryScratch& scratch) {
+    virtualInsertionWithSuff(lfg, r, l, Q, scratch);
+}
+
+//(inverseLF(from, i), inverseLF(from, j)), the records of the reverse of from and of a predecessor shared by i and j are decoded once
+std::pair<gbwt::edge_type,gbwt::edge_type> inverseLFPair(const gbwt::GBWT& g, const gbwt::node_type from, const gbwt::size_type i, const gbwt::size_type j) {
+    if (!g.bidirectional() || from == gbwt::ENDMARKER) { return {gbwt::invalid_edge(), gbwt::invalid_edge()}; }
+    gbwt::CompressedRecord reverse = g.record(gbwt::Node::reverse(from));
+    gbwt::node_type predI = reverse.predecessorAt(i), predJ = reverse.predecessorAt(j);
+    auto inverse = [from] (const gbwt::CompressedRecord& pred, gbwt::node_type node, gbwt::size_type k) {
+        gbwt::size_type offset = pred.offsetTo(from, k);
+        return (offset == gbwt::invalid_offset())? gbwt::invalid_edge() : gbwt::edge_type(node, offset);
+    };
+    std::pair<gbwt::edge_type,gbwt::edge_type> ans = {gbwt::invalid_edge(), gbwt::invalid_edge()};
+    if (predI != gbwt::invalid_node()) {
+        gbwt::CompressedRecord pred = g.record(predI);
+        ans.first = inverse(pred, predI, i);
+        if (predJ == predI) { ans.second = inverse(pred, predJ, j); }
+    }
+    if (predJ != gbwt::invalid_node() && predJ != predI)
+        ans.second = inverse(g.record(predJ), predJ, j);
+    return ans;
+}
+
+std::pair<gbwt::edge_type,gbwt::edge_type> inverseLFPair(const lf_gbwt::GBWT& lfg, const gbwt::node_type from, const gbwt::size_type i, const gbwt::size_type j) {
+    return lfg.inverseLF(from, i, j);
+}
+
+//lcps of Qs[k..] with the suffixes above and below a[k] if walkAbove and walkBelow, for lcpAboveBelowGBWT and lcpAboveBelowLFGBWT
+//while both walks are in node Qs[k+lcp] they are stepped by one inverseLFPair, then the remaining one by inverseLF
+//computedAbove and computedBelow are set to 1 + the last kp where the walk passes a[kp], lcpa[k..computedAbove) follow by decrementing
+template<class Index>
+std::pair<gbwt::size_type,gbwt::size_type> lcpAboveBelowWalk(const Index& g, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs, const gbwt::size_type k,
+        bool walkAbove, bool walkBelow, gbwt::size_type& computedAbove, gbwt::size_type& computedBelow) {
+    walkAbove = walkAbove && a[k] != 0;
+    walkBelow = walkBelow && a[k] != g.nodeSize(Qs[k]);
+    //above is only used if a[k] != 0
+    gbwt::edge_type above = {Qs[k], a[k]-1}, below = {Qs[k], a[k]};
+    gbwt::size_type lcp = 0;
+    while (walkAbove && walkBelow) {
+        walkAbove = above.first == Qs[k+lcp] && above.first != gbwt::ENDMARKER;
+        walkBelow = below.first == Qs[k+lcp] && below.first != gbwt::ENDMARKER;
+        if (!walkAbove || !walkBelow) { break; }
+        if (above.second + 1 == a[k+lcp]) { computedAbove = k + lcp + 1; }
+        if (below.second == a[k+lcp]) { computedBelow = k + lcp + 1; }
+        ++lcp;
+        std::tie(above, below) = IndexTraits<Index>::inverseLFPair(g, Qs[k+lcp-1], above.second, below.second);
+    }
+    gbwt::size_type lcpAbove = lcp, lcpBelow = lcp;
+    while (walkAbove && above.first == Qs[k+lcpAbove] && above.first != gbwt::ENDMARKER) {
+        if (above.second + 1 == a[k+lcpAbove]) { computedAbove = k + lcpAbove + 1; }
+        ++lcpAbove;
+        above = g.inverseLF(above);
+    }
+    while (walkBelow && below.first == Qs[k+lcpBelow] && below.first != gbwt::ENDMARKER) {
+        if (below.second == a[k+lcpBelow]) { computedBelow = k + lcpBelow + 1; }
+        ++lcpBelow;
+        below = g.inverseLF(below);
+    }
+    return {lcpAbove, lcpBelow};
 }
 
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>>
 lcpAboveBelowGBWT(const gbwt::GBWT& g, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs) {
-    //length of lcpa and lcpb that has been computed
-    gbwt::size_type computed_above = 0, computed_below = 0;
-    std::vector<gbwt::size_type> lcpa(Qs.size()), lcpb(Qs.size());
-    lcpa.shrink_to_fit();
-    lcpb.shrink_to_fit();
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k){
-        if (computed_above <= k) {
-            //compute lcpa[k]
-            gbwt::size_type lcp = 0;
-            computed_above = k + 1;
-            if (a[k] != 0) {
-                gbwt::edge_type above = {Qs[k], a[k]-1};
-                while (above.first == Qs[k+lcp] && above.first != gbwt::ENDMARKER) {
-                    if (above.second + 1 == a[k+lcp]) { computed_above = k + lcp + 1; }
-                    ++lcp;
-                    above = g.inverseLF(above);
-                }
-            }
-            for (gbwt::size_type kp = k; kp < computed_above; ++kp, --lcp)
-                lcpa[kp] = lcp;
-        }
-        if (computed_below <= k) {
-            //compute lcpb[k]
-            gbwt::size_type lcp = 0;
-            computed_below = k + 1;
-            if (a[k] != g.nodeSize(Qs[k])) {
-                gbwt::edge_type below = {Qs[k], a[k]};
-                while (below.first == Qs[k+lcp] && below.first != gbwt::ENDMARKER) {
-                    if (below.second == a[k+lcp]) { computed_below = k + lcp + 1; }
-                    ++lcp;
-                    below = g.inverseLF(below);
-                }
-            }
-            for (gbwt::size_type kp = k; kp < computed_below; ++kp, --lcp)
-                lcpb[kp] = lcp;
-        }
-    }
+    std::vector<gbwt::size_type> lcpa, lcpb;
+    lcpAboveBelowGBWT(g, a, Qs, lcpa, lcpb);
     return {lcpa, lcpb};
 }
 
+void lcpAboveBelowGBWT(const gbwt::GBWT& g, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb) {
+    lcpAboveBelow(g, a, Qs, lcpa, lcpb);
+}
+
 std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>>
 lcpAboveBelowLFGBWT(const lf_gbwt::GBWT& lfg, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs) {
+    std::vector<gbwt::size_type> lcpa, lcpb;
+    lcpAboveBelowLFGBWT(lfg, a, Qs, lcpa, lcpb);
+    return {lcpa, lcpb};
+}
+
+void lcpAboveBelowLFGBWT(const lf_gbwt::GBWT& lfg, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb) {
+    lcpAboveBelow(lfg, a, Qs, lcpa, lcpb);
+}
+
+void lcpAboveBelowLFGBWT(const lf_gbwt::GBWT& lfg, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb,
+        const gbwt::size_type kBegin, const gbwt::size_type kEnd) {
+    lcpAboveBelow(lfg, a, Qs, lcpa, lcpb, kBegin, kEnd);
+}
+
+//lcps of Qs with the suffixes above and below its virtual insertion positions a by inverseLF walks on any index, see lcpAboveBelowWalk
+template<class Index>
+void lcpAboveBelow(const Index& g, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb) {
+    lcpa.resize(Qs.size());
+    lcpb.resize(Qs.size());
+    lcpAboveBelow(g, a, Qs, lcpa, lcpb, 0, Qs.size());
+}
+
+//computes only lcpa[kBegin..kEnd) and lcpb[kBegin..kEnd), lcpa and lcpb must already have length |Qs|
+//walks may read past kEnd but only write inside the range, so disjoint ranges can be computed concurrently
+template<class Index>
+void lcpAboveBelow(const Index& g, const std::vector<gbwt::size_type>& a, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb,
+        const gbwt::size_type kBegin, const gbwt::size_type kEnd) {
+    assert(lcpa.size() == Qs.size() && lcpb.size() == Qs.size() && kEnd <= Qs.size());
     //length of lcpa and lcpb that has been computed
-    gbwt::size_type computed_above = 0, computed_below = 0;
-    std::vector<gbwt::size_type> lcpa(Qs.size()), lcpb(Qs.size());
-    lcpa.shrink_to_fit();
-    lcpb.shrink_to_fit();
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k){
-        if (computed_above <= k) {
-            //compute lcpa[k]
-            gbwt::size_type lcp = 0;
-            computed_above = k + 1;
-            if (a[k] != 0) {
-                gbwt::edge_type above = {Qs[k], a[k]-1};
-                while (above.first == Qs[k+lcp] && above.first != gbwt::ENDMARKER) {
-                    if (above.second + 1 == a[k+lcp]) { computed_above = k + lcp + 1; }
-                    ++lcp;
-                    above = lfg.inverseLF(above);
-                }
-            }
-            for (gbwt::size_type kp = k; kp < computed_above; ++kp, --lcp)
-                lcpa[kp] = lcp;
-        }
-        if (computed_below <= k) {
-            //compute lcpb[k]
-            gbwt::size_type lcp = 0;
-            computed_below = k + 1;
-            if (a[k] != lfg.nodeSize(Qs[k])) {
-                gbwt::edge_type below = {Qs[k], a[k]};
-                while (below.first == Qs[k+lcp] && below.first != gbwt::ENDMARKER) {
-                    if (below.second == a[k+lcp]) { computed_below = k + lcp + 1; }
-                    ++lcp;
-                    below = lfg.inverseLF(below);
-                }
-            }
-            for (gbwt::size_type kp = k; kp < computed_below; ++kp, --lcp)
-                lcpb[kp] = lcp;
-        }
+    gbwt::size_type computed_above = kBegin, computed_below = kBegin;
+    for (gbwt::size_type k = kBegin; k < kEnd; ++k){
+        bool above = computed_above <= k, below = computed_below <= k;
+        if (!above && !below) { continue; }
+        //compute lcpa[k] and/or lcpb[k]
+        if (above) { computed_above = k + 1; }
+        if (below) { computed_below = k + 1; }
+        gbwt::size_type lcp_above, lcp_below;
+        std::tie(lcp_above, lcp_below) = lcpAboveBelowWalk(g, a, Qs, k, above, below, computed_above, computed_below);
+        if (above)
+            for (gbwt::size_type kp = k; kp < std::min(computed_above, kEnd); ++kp, --lcp_above)
+                lcpa[kp] = lcp_above;
+        if (below)
+            for (gbwt::size_type kp = k; kp < std::min(computed_below, kEnd); ++kp, --lcp_below)
+                lcpb[kp] = lcp_below;
     }
-    return {lcpa, lcpb};
 }
 
-std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> 
+std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>>
 lcpAboveBelowCT(const lf_gbwt::GBWT& lfg, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs) {
-    std::vector<gbwt::size_type> lcpa(Qs.size()), lcpb(Qs.size());
-    lcpa.shrink_to_fit();
-    lcpb.shrink_to_fit();
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k) {
-        gbwt::size_type lcp = 0;
-        if (a[k] != 0) {
-            lcp = (k == 0 || lcpa[k-1] == 0)? 0 : (lcpa[k-1] - 1);
-            gbwt::size_type suff = (a[k] == lfg.nodeSize(Qs[k]))? l.locateLast(Qs[k]) : l.locatePrev(s[k]);
-            suff = ct.FLsuffToTrueSuff(suff);
-            while(ct.at(suff+lcp) == Qs[k+lcp] && Qs[k+lcp] != gbwt::ENDMARKER)
-                ++lcp;
-        }
-        lcpa[k] = lcp;
-        lcp = 0;
-        if (a[k] != lfg.nodeSize(Qs[k])){
-            lcp = (k == 0 || lcpb[k-1] == 0)? 0 : (lcpb[k-1] - 1);
-            gbwt::size_type suff = ct.FLsuffToTrueSuff(s[k]);
-            while (ct.at(suff+lcp) == Qs[k+lcp] && Qs[k+lcp] != gbwt::ENDMARKER)
-                ++lcp;
-        }
-        lcpb[k] = lcp;
-    }
+    std::vector<gbwt::size_type> lcpa, lcpb;
+    lcpAboveBelowCT(lfg, l, ct, a, s, Qs, lcpa, lcpb);
     return {lcpa, lcpb};
 }
 
-std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>> 
-lcpAboveBelowCT(const gbwt::GBWT& g, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs) {
-    std::vector<gbwt::size_type> lcpa(Qs.size()), lcpb(Qs.size());
-    lcpa.shrink_to_fit();
-    lcpb.shrink_to_fit();
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k) {
+void lcpAboveBelowCT(const lf_gbwt::GBWT& lfg, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb) {
+    lcpa.resize(Qs.size());
+    lcpb.resize(Qs.size());
+    lcpAboveBelowCT(lfg, l, ct, a, s, Qs, lcpa, lcpb, 0, Qs.size());
+}
+
+//computes only lcpa[kBegin..kEnd) and lcpb[kBegin..kEnd), lcpa and lcpb must already have length |Qs|
+//the first position of the range is compared from scratch, so disjoint ranges can be computed concurrently
+template<class Index>
+void lcpAboveBelowCT(const Index& g, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb,
+        const gbwt::size_type kBegin, const gbwt::size_type kEnd) {
+    assert(lcpa.size() == Qs.size() && lcpb.size() == Qs.size() && kEnd <= Qs.size());
+    for (gbwt::size_type k = kBegin; k < kEnd; ++k) {
         gbwt::size_type lcp = 0;
         if (a[k] != 0) {
-            lcp = (k == 0 || lcpa[k-1] == 0)? 0 : (lcpa[k-1] - 1);
+            lcp = (k == kBegin || lcpa[k-1] == 0)? 0 : (lcpa[k-1] - 1);
             gbwt::size_type suff = (a[k] == g.nodeSize(Qs[k]))? l.locateLast(Qs[k]) : l.locatePrev(s[k]);
             suff = ct.FLsuffToTrueSuff(suff);
             while(ct.at(suff+lcp) == Qs[k+lcp] && Qs[k+lcp] != gbwt::ENDMARKER)
@@ -419,16 +889,47 @@ lcpAboveBelowCT(const gbwt::GBWT& g, const FastLCP& l, const CompText& ct, const
         lcpa[k] = lcp;
         lcp = 0;
         if (a[k] != g.nodeSize(Qs[k])){
-            lcp = (k == 0 || lcpb[k-1] == 0)? 0 : (lcpb[k-1] - 1);
+            lcp = (k == kBegin || lcpb[k-1] == 0)? 0 : (lcpb[k-1] - 1);
             gbwt::size_type suff = ct.FLsuffToTrueSuff(s[k]);
             while (ct.at(suff+lcp) == Qs[k+lcp] && Qs[k+lcp] != gbwt::ENDMARKER)
                 ++lcp;
         }
         lcpb[k] = lcp;
     }
+}
+
+std::pair<std::vector<gbwt::size_type>,std::vector<gbwt::size_type>>
+lcpAboveBelowCT(const gbwt::GBWT& g, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs) {
+    std::vector<gbwt::size_type> lcpa, lcpb;
+    lcpAboveBelowCT(g, l, ct, a, s, Qs, lcpa, lcpb);
     return {lcpa, lcpb};
 }
 
+void lcpAboveBelowCT(const gbwt::GBWT& g, const FastLCP& l, const CompText& ct, const std::vector<gbwt::size_type>& a, const std::vector<gbwt::size_type>& s, const gbwt::vector_type& Qs, std::vector<gbwt::size_type>& lcpa, std::vector<gbwt::size_type>& lcpb) {
+    lcpa.resize(Qs.size());
+    lcpb.resize(Qs.size());
+    lcpAboveBelowCT(g, l, ct, a, s, Qs, lcpa, lcpb, 0, Qs.size());
+}
+
+//lcps of the virtual insertion in scratch, by CompText comparisons if ct is given (versions 4 and 2_4)
+//and by inverseLF walks otherwise (versions 2 and 3)
+template<class Index>
+void queryLcps(const Index& g, const FastLCP& l, const CompText* ct, QueryScratch& scratch) {
+    if (ct) { 
+        scratch.lcpa.resize(scratch.Qs.size());
+        scratch.lcpb.resize(scratch.Qs.size());
+        lcpAboveBelowCT(g, l, *ct, scratch.a, scratch.s, scratch.Qs, scratch.lcpa, scratch.lcpb, 0, scratch.Qs.size()); 
+    }
+    else { lcpAboveBelow(g, scratch.a, scratch.Qs, scratch.lcpa, scratch.lcpb); }
+}
+
+//queryLcps on the samples of a FastRLCP, the CompText comparisons need a FastLCP so the lcps are walked
+template<class Index, class LCPs>
+void queryLcps(const Index& g, const LCPs&, const CompText* ct, QueryScratch& scratch) {
+    if (ct) { throw std::invalid_argument("queryLcps: CompText lcps need a FastLCP!"); }
+    lcpAboveBelow(g, scratch.a, scratch.Qs, scratch.lcpa, scratch.lcpb);
+}
+
 void AddMatchesGBWT(const gbwt::GBWT& x, const gbwt::vector_type& Q, gbwt::size_type k,
         gbwt::size_type len, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches){
     //std::cout << "AddMatchesGBWT called: " << k << ' ' << len << std::endl;
@@ -455,11 +956,24 @@ gbwt::size_type endmarkerSampleFastLocate(const gbwt::FastLocate& r, gbwt::size_
 void AddMatchesFastLocate(const gbwt::GBWT& x, const gbwt::FastLocate& r, const gbwt::vector_type& Q, 
         gbwt::size_type k, gbwt::size_type len, 
         std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches){
+    std::unordered_map<gbwt::size_type,gbwt::size_type> pathLengths;
+    AddMatchesFastLocate(x, r, Q, k, len, matches, pathLengths);
+}
+
+//pathLengths holds the lengths of the paths already matched by this query, so each path's endmarker sample is searched for once per query
+//instead of once per match
+void AddMatchesFastLocate(const gbwt::GBWT& x, const gbwt::FastLocate& r, const gbwt::vector_type& Q, 
+        gbwt::size_type k, gbwt::size_type len, 
+        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches,
+        std::unordered_map<gbwt::size_type,gbwt::size_type>& pathLengths){
     gbwt::size_type first = 0;
     gbwt::SearchState ss = r.find(Q.begin()+k, Q.begin()+k+len, first);
     gbwt::size_type plen;
     for (unsigned i = 0; i<ss.size(); ++i){
-        plen = r.seqOffset(endmarkerSampleFastLocate(r, r.seqId(first))); 
+        auto it = pathLengths.find(r.seqId(first));
+        if (it == pathLengths.end())
+            it = pathLengths.emplace(r.seqId(first), r.seqOffset(endmarkerSampleFastLocate(r, r.seqId(first)))).first;
+        plen = it->second;
         matches.emplace_back(k, len, r.seqId(first), plen - r.seqOffset(first) - len);
         first = r.locateNext(first);
     }
@@ -470,23 +984,65 @@ gbwt::size_type endmarkerSampleFastLCP(const FastLCP& l, gbwt::size_type i){
     return iter->second + l.samples_lcp[iter->first];
 }
 
-void AddMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q,
+//AddMatchesFastLCP on a node cached in hot, suffixes and lcps are read from the cached arrays
+template<class Locate, class LCPs, class Sink>
+void AddMatchesHotNode(const Locate& r, const LCPs& l, const HotNodeCache& hot, const gbwt::size_type hotInd,
+        gbwt::size_type k, gbwt::size_type len, gbwt::size_type pos, gbwt::size_type lcpa, gbwt::size_type lcpb,
+        Sink& matches) {
+    const gbwt::size_type* sa = hot.suffixes(hotInd), * lcp = hot.lcps(hotInd);
+    gbwt::size_type n = hot.nodeSize(hotInd), plen;
+    auto filter = matchFilter(matches);
+    //do above matches
+    for (gbwt::size_type i = pos; lcpa == len; ) {
+        --i;
+        if (!filter || filter->contains(r.seqId(sa[i]))) {
+            plen = l.pathLength(r.seqId(sa[i]));
+            emitMatch(matches, k, len, r.seqId(sa[i]), plen - r.seqOffset(sa[i]) - len);
+        }
+        lcpa = std::min(lcpa, lcp[i]);
+    }
+    //do below matches
+    for (gbwt::size_type i = pos; lcpb == len; ) {
+        if (!filter || filter->contains(r.seqId(sa[i]))) {
+            plen = l.pathLength(r.seqId(sa[i]));
+            emitMatch(matches, k, len, r.seqId(sa[i]), plen - r.seqOffset(sa[i]) - len);
+        }
+        if (++i == n) { break; }
+        lcpb = std::min(lcpb, lcp[i]);
+    }
+}
+
+//writes the matches of Q[k, k+len) around the virtual insertion position pos (suffix below suff) in node Q[k+len-1],
+//rows above are reported while lcpa == len and rows below while lcpb == len, on any index
+template<class Index, class Locate, class LCPs, class Sink>
+void AddMatchesFastLCP(const Index& g, const Locate& r, const LCPs& l, const gbwt::vector_type& Q,
         gbwt::size_type k, gbwt::size_type len, 
         gbwt::size_type pos, gbwt::size_type suff, gbwt::size_type lcpa, gbwt::size_type lcpb,
-        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches) {
+        Sink& matches, const HotNodeCache* hot) {
+    auto filter = matchFilter(matches);
+    if (filter && !filter->nodeHasMembers(l, Q[k+len-1])) { return; }
+    gbwt::size_type hotInd = (hot)? hot->find(Q[k+len-1]) : gbwt::invalid_offset();
+    if (hotInd != gbwt::invalid_offset()) {
+        AddMatchesHotNode(r, l, *hot, hotInd, k, len, pos, lcpa, lcpb, matches);
+        return;
+    }
     //do above matches
     gbwt::size_type curr_s = suff, plen;
     while (lcpa == len) {
         curr_s = (curr_s == suff && pos == g.nodeSize(Q[k+len-1]))? l.locateLast(Q[k+len-1]) : l.locatePrev(curr_s);
-        plen = r.seqOffset(endmarkerSampleFastLCP(l, r.seqId(curr_s)));
-        matches.emplace_back(k, len, r.seqId(curr_s), plen - r.seqOffset(curr_s) - len);
+        if (!filter || filter->contains(r.seqId(curr_s))) {
+            plen = l.pathLength(r.seqId(curr_s));
+            emitMatch(matches, k, len, r.seqId(curr_s), plen - r.seqOffset(curr_s) - len);
+        }
         lcpa = std::min(lcpa, l.LCP(curr_s));
     }
     //do below matches
     curr_s = suff;
     while (lcpb == len) {
-        plen = r.seqOffset(endmarkerSampleFastLCP(l, r.seqId(curr_s)));
-        matches.emplace_back(k, len, r.seqId(curr_s), plen - r.seqOffset(curr_s) - len);
+        if (!filter || filter->contains(r.seqId(curr_s))) {
+            plen = l.pathLength(r.seqId(curr_s));
+            emitMatch(matches, k, len, r.seqId(curr_s), plen - r.seqOffset(curr_s) - len);
+        }
         ++pos;
         if (pos == g.nodeSize(Q[k+len-1])) { break; }
         curr_s = r.locateNext(curr_s);
@@ -494,44 +1050,33 @@ void AddMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const Fas
     }
 }
 
+template<class Sink>
 void AddMatchesFastLCPLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, const gbwt::vector_type& Q,
         gbwt::size_type k, gbwt::size_type len,
         gbwt::size_type pos, gbwt::size_type suff, gbwt::size_type lcpa, gbwt::size_type lcpb,
-        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches) {
-    //std::cout << "In AddMatchesFastLCPLFGBWT" << std::endl;
-    //do above matches
-    gbwt::size_type curr_s = suff, plen;
-    while (lcpa == len) {
-        curr_s = (curr_s == suff && pos == lfg.nodeSize(Q[k+len-1]))? l.locateLast(Q[k+len-1]) : l.locatePrev(curr_s);
-        plen = r.seqOffset(endmarkerSampleFastLCP(l, r.seqId(curr_s)));
-        matches.emplace_back(k, len, r.seqId(curr_s), plen - r.seqOffset(curr_s) - len);
-        lcpa = std::min(lcpa, l.LCP(curr_s));
-    }
-    //std::cout << "Done above matches" << std::endl;
-    //do below matches
-    curr_s = suff;
-    while (lcpb == len) {
-        plen = r.seqOffset(endmarkerSampleFastLCP(l, r.seqId(curr_s)));
-        matches.emplace_back(k, len, r.seqId(curr_s), plen - r.seqOffset(curr_s) - len);
-        ++pos;
-        if (pos == lfg.nodeSize(Q[k+len-1])) { break; }
-        curr_s = r.locateNext(curr_s);
-        lcpb = std::min(lcpb, l.LCP(curr_s));
-    }
-    //std::cout << "Leaving AddMatchesFastLCPLFGBWT" << std::endl;
+        Sink& matches, const HotNodeCache* hot) {
+    AddMatchesFastLCP(lfg, r, l, Q, k, len, pos, suff, lcpa, lcpb, matches, hot);
 }
 
-
-void AddLongMatchesWholeBlock(const gbwt::FastLocate& r, const FastLCP& l, std::map<gbwt::size_type, gbwt::size_type>& inBlock, const gbwt::size_type currQsInd, const gbwt::vector_type& Qs, 
-        const gbwt::range_type block, const gbwt::size_type topSuff, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches) {
+//Qs is a gbwt::vector_type or a QsWindow holding Qs[currQsInd] and Qs[currQsInd-1]
+template<class Sink, class QsType>
+void AddLongMatchesWholeBlock(const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, const gbwt::size_type currQsInd, const QsType& Qs, 
+        const gbwt::range_type block, const gbwt::size_type topSuff, Sink& matches,
+        const HotNodeCache* hot = nullptr) {
     //std::cout << "In AddLongMatchesWholeBlock(currQsInd " << currQsInd << ", block [" << block.first << ", " << block.second << "], topSuff " << topSuff << ")" << std::endl;
+    auto filter = matchFilter(matches);
+    //only members are in inBlock
+    if (filter && inBlock.empty()) { return; }
+    gbwt::size_type hotInd = (hot && !gbwt::Range::empty(block))? hot->find(Qs[currQsInd]) : gbwt::invalid_offset();
+    const gbwt::size_type* sa = (hotInd != gbwt::invalid_offset())? hot->suffixes(hotInd) : nullptr;
     gbwt::size_type suff;
     for (gbwt::size_type blockInd = block.first; blockInd != block.second + 1; ++blockInd){
-        suff = (blockInd == block.first)? topSuff : r.locateNext(suff);
+        suff = (sa)? sa[blockInd] : (blockInd == block.first)? topSuff : r.locateNext(suff);
+        if (filter && !filter->contains(r.seqId(suff))) { continue; }
         auto it = inBlock.find(suff + Qs.size() - currQsInd);
         assert(it != inBlock.end());
-        gbwt::size_type plen = r.seqOffset(endmarkerSampleFastLCP(l, r.seqId(suff)));
-        matches.emplace_back(Qs.size() - 1 - it->second, it->second - currQsInd, r.seqId(suff), plen - r.seqOffset(suff) - (it->second - currQsInd));
+        gbwt::size_type plen = l.pathLength(r.seqId(suff));
+        emitMatch(matches, Qs.size() - 1 - it->second, it->second - currQsInd, r.seqId(suff), plen - r.seqOffset(suff) - (it->second - currQsInd));
         inBlock.erase(it);
     }
 }
@@ -541,12 +1086,15 @@ void AddLongMatchesWholeBlock(const gbwt::FastLocate& r, const FastLCP& l, std::
 //returns block i-1 of length L+1 and top and bottom suffixes of this block (inclusive)
 //if block is empty, top and bot suffix are invalid and returned block is arbitrary empty block
 //assumes block is valid
+template<class Sink, class QsType>
 std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type>
-AddLongMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, std::map<gbwt::size_type, gbwt::size_type>& inBlock, const gbwt::size_type currQsInd, 
-        const gbwt::vector_type& Qs, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches) {
+AddLongMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, const gbwt::size_type currQsInd, 
+        const QsType& Qs, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, Sink& matches,
+        const HotNodeCache* hot) {
     if (gbwt::Range::empty(block)) { return {gbwt::Range::empty_range(), gbwt::invalid_offset(), gbwt::invalid_offset()}; }
     assert(currQsInd != 0);
-    assert(inBlock.size() == gbwt::Range::length(block));
+    auto filter = matchFilter(matches);
+    assert(blockMapAgrees(inBlock, block, filter));
     assert(block.second < g.nodeSize(Qs[currQsInd]) && block.first <= block.second);
     assert(topSuff < r.pack(g.sequences(), 0) && botSuff < r.pack(g.sequences(), 0));
 
@@ -588,7 +1136,7 @@ AddLongMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const Fast
         newBlock.second -= !botSuffContinue;
     }
     if (gbwt::Range::empty(newBlock)) {
-        AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, block, topSuff, matches);
+        AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, block, topSuff, matches, hot);
         return {gbwt::Range::empty_range(), gbwt::invalid_offset(), gbwt::invalid_offset()};
     }
 
@@ -603,8 +1151,11 @@ AddLongMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const Fast
         }
         else { 
             gbwt::range_type runBlock = {std::max(block.first, topIter.offset() - topIter->second), std::min(block.second, topIter.offset() - 1)};
-            gbwt::size_type firstSuff = (block.first == runBlock.first)? topSuff : l.getSample(from, firstRunId(topIter));
-            AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, runBlock, firstSuff, matches); 
+            //runs without members have no suffixes in inBlock
+            if (!filter || filter->runsHaveMembers(l, from, runIdPos(topIter, runBlock.first), runIdPos(topIter, runBlock.second))) {
+                gbwt::size_type firstSuff = (block.first == runBlock.first)? topSuff : l.getSample(from, firstRunId(topIter));
+                AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, runBlock, firstSuff, matches, hot); 
+            }
         }
         if (topIter.runId() == botIter.runId()) { break; }
         ++topIter;
@@ -614,10 +1165,11 @@ AddLongMatchesFastLCP(const gbwt::GBWT& g, const gbwt::FastLocate& r, const Fast
     return {newBlock, ((topSuffContinue)? topSuff - 1 : l.getSample(from, firstOutrankRunId) - 1), ((botSuffContinue)? botSuff - 1 : l.getSampleBot(from, lastOutrankRunId) - 1)};
 }
 
+template<class Filter = HaplotypeFilter>
 std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type>
-LongMatchesFastLCPInitializeEmptyBlock(const gbwt::FastLocate& r, const FastLCP& l, std::map<gbwt::size_type,gbwt::size_type>& inBlock, 
+LongMatchesFastLCPInitializeEmptyBlock(const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, 
         const gbwt::size_type nodePos, const gbwt::node_type node, const gbwt::size_type nodeSize, const gbwt::size_type bSuff, const gbwt::size_type lcpa, const gbwt::size_type lcpb, 
-        const gbwt::size_type queryLen, const gbwt::size_type queryPos, const gbwt::size_type L) {
+        const gbwt::size_type queryLen, const gbwt::size_type queryPos, const gbwt::size_type L, const Filter* filter = nullptr) {
     //std::cout << "LongMatchesFastLCPInitializeEmptyBlock(nodePos " << nodePos << ", node " << node << ", nodeSize " << nodeSize << ", bSuff " << bSuff << ", lcpa " << lcpa << ", lcpb " << lcpb 
         //<< ", queryLen " << queryLen << ", " << queryPos << ", L " << L << ")" << std::endl;
     assert(nodePos <= nodeSize);
@@ -638,38 +1190,123 @@ LongMatchesFastLCPInitializeEmptyBlock(const gbwt::FastLocate& r, const FastLCP&
         block = {nodePos-1, nodePos-1};
         suff = (nodePos == nodeSize)? l.locateLast(node) : l.locatePrev(bSuff);
     }
-    inBlock.emplace(suff + queryLen - queryPos, queryPos + L);
+    if (!filter || filter->contains(r.seqId(suff))) { inBlock.emplace(suff + queryLen - queryPos, queryPos + L); }
     return {block, suff, suff};
 }
 
+//computes block [f^L_{queryPos}, g^L_{queryPos} - 1] from scratch using the virtual insertion position and lcps at queryPos,
+//the suffixes are inserted in inBlock with the end of their match, as if the block had been carried from the end of Qs,
+//so a long match query can be resumed at queryPos. assumes inBlock is empty, returns empty block and invalid suffixes if the block is empty
+template<class Filter = HaplotypeFilter>
+std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type>
+LongMatchesFastLCPBuildBlock(const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, 
+        const gbwt::size_type nodePos, const gbwt::node_type node, const gbwt::size_type nodeSize, const gbwt::size_type bSuff, const gbwt::size_type lcpa, const gbwt::size_type lcpb, 
+        const gbwt::size_type queryLen, const gbwt::size_type queryPos, const gbwt::size_type L, const Filter* filter = nullptr) {
+    assert(inBlock.empty());
+    if (std::max(lcpa, lcpb) < L) { return {gbwt::Range::empty_range(), gbwt::invalid_offset(), gbwt::invalid_offset()}; }
+    assert(nodePos <= nodeSize);
+    gbwt::range_type block = {nodePos, nodePos};
+    gbwt::size_type topSuff = bSuff, botSuff = bSuff, lcp;
+    bool succeed;
+    if (lcpb >= L) {
+        assert(nodePos < nodeSize);
+        lcp = lcpb;
+        if (!filter || filter->contains(r.seqId(bSuff))) {
+            succeed = inBlock.emplace(bSuff + queryLen - queryPos, queryPos + lcp).second;
+            assert(succeed);
+        }
+        while (block.second + 1 < nodeSize) {
+            gbwt::size_type nextSuff = r.locateNext(botSuff);
+            lcp = std::min(lcp, l.LCP(nextSuff));
+            if (lcp < L) { break; }
+            ++block.second;
+            botSuff = nextSuff;
+            if (!filter || filter->contains(r.seqId(botSuff))) {
+                succeed = inBlock.emplace(botSuff + queryLen - queryPos, queryPos + lcp).second;
+                assert(succeed);
+            }
+        }
+    }
+    if (lcpa >= L) {
+        assert(nodePos != 0);
+        lcp = lcpa;
+        block.first = nodePos - 1;
+        topSuff = (nodePos == nodeSize)? l.locateLast(node) : l.locatePrev(bSuff);
+        if (lcpb < L) { block.second = block.first; botSuff = topSuff; }
+        if (!filter || filter->contains(r.seqId(topSuff))) {
+            succeed = inBlock.emplace(topSuff + queryLen - queryPos, queryPos + lcp).second;
+            assert(succeed);
+        }
+        while (block.first != 0) {
+            lcp = std::min(lcp, l.LCP(topSuff));
+            if (lcp < L) { break; }
+            --block.first;
+            topSuff = l.locatePrev(topSuff);
+            if (!filter || filter->contains(r.seqId(topSuff))) {
+                succeed = inBlock.emplace(topSuff + queryLen - queryPos, queryPos + lcp).second;
+                assert(succeed);
+            }
+        }
+    }
+    return {block, topSuff, botSuff};
+}
+
 //given [f^{L+1}_{queryPos}, g^{L+1}_{queryPos} - 1] 
 //if [f^{L+1}_{queryPos}, g^{L+1}_{queryPos} - 1] and output block is nonempty, provided block is [a,a]
 //where the LCP of the suffix at a and Q[queryPos...] is length L and is a longest LCP
 //compute nonempty block [f^L_{queryPos}, g^L_{queryPos} - 1]
+//if hot is given, node is the node of block and its cached arrays are scanned when node is in hot
+//if filter is given only its members are inserted in inBlock, as in LongMatchesFastLCPInitializeEmptyBlock and LongMatchesFastLCPBuildBlock
+template<class Filter = HaplotypeFilter>
 std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type>
-LongMatchesExpandNonEmptyBlock(const gbwt::FastLocate& r, const FastLCP& l, std::map<gbwt::size_type,gbwt::size_type>& inBlock,
+LongMatchesExpandNonEmptyBlock(const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock,
         const gbwt::size_type nodeSize, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff,
-        const gbwt::size_type queryLen, const gbwt::size_type queryPos, const gbwt::size_type L) {
+        const gbwt::size_type queryLen, const gbwt::size_type queryPos, const gbwt::size_type L,
+        const HotNodeCache* hot = nullptr, const gbwt::node_type node = gbwt::ENDMARKER, const Filter* filter = nullptr) {
     //std::cout << "LongMatchesExpandNonEmptyBlock(nodeSize " << nodeSize << ", block [" << block.first << "," << block.second << "], topSuff " << topSuff << ", botSuff " << botSuff << ", queryLen " << queryLen
         //<< ", queryPos " << queryPos << ", L " << L << ")" << std::endl;
     assert(block.first < nodeSize && block.second < nodeSize && block.second >= block.first);
     gbwt::range_type newBlock = block;
     gbwt::size_type newTopSuff = topSuff, newBotSuff = botSuff, nextSuff;
     bool succeed;
+    gbwt::size_type hotInd = (hot)? hot->find(node) : gbwt::invalid_offset();
+    if (hotInd != gbwt::invalid_offset()) {
+        const gbwt::size_type* sa = hot->suffixes(hotInd), * lcp = hot->lcps(hotInd);
+        while (lcp[newBlock.first] >= L) {
+            assert(newBlock.first != 0);
+            --newBlock.first;
+            if (!filter || filter->contains(r.seqId(sa[newBlock.first]))) {
+                succeed = inBlock.emplace(sa[newBlock.first] + queryLen - queryPos, queryPos + L).second;
+                assert(succeed);
+            }
+        }
+        while (newBlock.second + 1 < nodeSize && lcp[newBlock.second + 1] >= L) {
+            ++newBlock.second;
+            if (!filter || filter->contains(r.seqId(sa[newBlock.second]))) {
+                succeed = inBlock.emplace(sa[newBlock.second] + queryLen - queryPos, queryPos + L).second;
+                assert(succeed);
+            }
+        }
+        return {newBlock, sa[newBlock.first], sa[newBlock.second]};
+    }
     while (l.LCP(newTopSuff) >= L) {
         assert(newBlock.first != 0);
         newTopSuff = l.locatePrev(newTopSuff);
         --newBlock.first;
-        succeed = inBlock.emplace(newTopSuff + queryLen - queryPos, queryPos + L).second;
-        assert(succeed);
+        if (!filter || filter->contains(r.seqId(newTopSuff))) {
+            succeed = inBlock.emplace(newTopSuff + queryLen - queryPos, queryPos + L).second;
+            assert(succeed);
+        }
     }
     while (newBlock.second + 1 < nodeSize) {
         nextSuff = r.locateNext(newBotSuff);
         if (l.LCP(nextSuff) < L) { break; }
         ++newBlock.second;
         newBotSuff = nextSuff;
-        succeed = inBlock.emplace(newBotSuff + queryLen - queryPos, queryPos + L).second;
-        assert(succeed);
+        if (!filter || filter->contains(r.seqId(newBotSuff))) {
+            succeed = inBlock.emplace(newBotSuff + queryLen - queryPos, queryPos + L).second;
+            assert(succeed);
+        }
     }
     return {newBlock, newTopSuff, newBotSuff};
 }
@@ -678,12 +1315,15 @@ LongMatchesExpandNonEmptyBlock(const gbwt::FastLocate& r, const FastLCP& l, std:
 //returns block i-1 of length L+1 and top and bottom suffixes of this block (inclusive)
 //if block is empty, top and bot suffix are invalid and returned block is arbitrary empty block
 //assumes block is valid
+template<class Sink, class QsType>
 std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type>
-AddLongMatchesLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, std::map<gbwt::size_type, gbwt::size_type>& inBlock, const gbwt::size_type currQsInd, 
-        const gbwt::vector_type& Qs, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& matches) {
+AddLongMatchesLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const FastLCP& l, SuffixBlockMap& inBlock, const gbwt::size_type currQsInd, 
+        const QsType& Qs, const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, Sink& matches,
+        const HotNodeCache* hot) {
     if (gbwt::Range::empty(block)) { return {gbwt::Range::empty_range(), gbwt::invalid_offset(), gbwt::invalid_offset()}; }
     assert(currQsInd != 0);
-    assert(inBlock.size() == gbwt::Range::length(block));
+    auto filter = matchFilter(matches);
+    assert(blockMapAgrees(inBlock, block, filter));
     assert(block.second < lfg.nodeSize(Qs[currQsInd]) && block.first <= block.second);
     assert(topSuff < r.pack(lfg.sequences(), 0) && botSuff < r.pack(lfg.sequences(), 0));
 
@@ -702,11 +1342,12 @@ AddLongMatchesLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const
     }
     //std::cout << "newBlock: [" << newBlock.first << "," << newBlock.second << "]" << std::endl;
     if (gbwt::Range::empty(newBlock)) {
-        AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, block, topSuff, matches);
+        AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, block, topSuff, matches, hot);
         return {gbwt::Range::empty_range(), gbwt::invalid_offset(), gbwt::invalid_offset()};
     }
 
     gbwt::size_type prefixSum = (ind.first)? lfg.smallRecords.prefixSum.select_iter(t.second + 1)->second : 0;
+    gbwt::size_type endmarkerRank = (ind.first)? lfg.smallRecords.edgeTo(ind.second, lfg.toComp(gbwt::ENDMARKER)) : lfg.largeRecords[ind.second].edgeTo(lfg.toComp(gbwt::ENDMARKER));
     sdsl::sd_vector<>::one_iterator start = ((ind.first)? lfg.smallRecords.first.predecessor(prefixSum + block.first) : lfg.largeRecords[ind.second].first.predecessor(block.first)), 
         end = ((ind.first)? lfg.smallRecords.first.successor(prefixSum + block.second + 1) : lfg.largeRecords[ind.second].first.successor(block.second + 1));
     //std::cout << "start->second - prefixSum" << start->second - prefixSum 
@@ -718,13 +1359,13 @@ AddLongMatchesLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const
         if (runVal == outrank) { continue; }
         gbwt::range_type runBlock = {std::max(block.first, start->second - prefixSum), std::min(block.second, next->second - prefixSum - 1)};
         //std::cout << "adding run [" << runBlock.first << ", " << runBlock.second << "]" << std::endl;
-        gbwt::size_type firstSuff = (block.first == runBlock.first)? topSuff : 
-            l.getSample(Qs[currQsInd], 
-                    ((ind.first)? lfg.smallRecords.logicalRunId(ind.second, start->second - prefixSum): lfg.largeRecords[ind.second].logicalRunId(start->second))
-                    );
+        gbwt::size_type runId = (ind.first)? lfg.smallRecords.logicalRunId(ind.second, start->second - prefixSum): lfg.largeRecords[ind.second].logicalRunId(start->second);
+        //runs without members have no suffixes in inBlock, runs of the endmarker are split into several logical runs and checked by suffix
+        if (filter && runVal != endmarkerRank && !filter->runHasMembers(l, Qs[currQsInd], runId)) { continue; }
+        gbwt::size_type firstSuff = (block.first == runBlock.first)? topSuff : l.getSample(Qs[currQsInd], runId);
         //if (ind.first)
             //std::cout << "lfg.smallRecords.logicalRunId(ind.second, start->second - prefixSum) " << lfg.smallRecords.logicalRunId(ind.second, start->second - prefixSum) << std::endl;
-        AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, runBlock, firstSuff, matches);
+        AddLongMatchesWholeBlock(r, l, inBlock, currQsInd, Qs, runBlock, firstSuff, matches, hot);
     }
 
     gbwt::size_type newTopSuff, newBotSuff;
@@ -755,4 +1396,28 @@ AddLongMatchesLFGBWT(const lf_gbwt::GBWT& lfg, const gbwt::FastLocate& r, const
 
     return {newBlock, newTopSuff, newBotSuff};
 }
+
+//steps the block of the rows of node Qs[k+1] with an lcp of at least t' with Qs[k+1..] to the block of the rows of node Qs[k]
+//with an lcp of at least t with Qs[k..], t <= t'+1 and t = 0 for an empty block. The block is found as in longMatchQueryT with
+//a CountSink, so only the suffixes at its edges are located. Its size is the number of occurrences of Qs[k, k+t) in the paths,
+//so the count queries (see longMatchCountQueryT and setMaximalMatchCountQueryT) read counts off the block instead of locating them
+template<class Index>
+std::tuple<gbwt::range_type,gbwt::size_type,gbwt::size_type>
+countBlockStep(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, QueryScratch& scratch, const gbwt::size_type k, const gbwt::size_type t,
+        const gbwt::range_type block, const gbwt::size_type topSuff, const gbwt::size_type botSuff, const HotNodeCache* hot = nullptr) {
+    const gbwt::vector_type& Qs = scratch.Qs;
+    CountSink none;
+    auto filter = matchFilter(none);
+    gbwt::range_type next;
+    gbwt::size_type nextTop, nextBot;
+    std::tie(next, nextTop, nextBot) = IndexTraits<Index>::AddLongMatches(g, r, l, scratch.inBlock, k + 1, Qs, block, topSuff, botSuff, none, hot);
+    assert(scratch.inBlock.empty());
+    //the rows of the stepped block share Qs[k, k+t'+1) with Qs[k..], so t = 0 only follows an empty step
+    assert(t != 0 || gbwt::Range::empty(next));
+    if (t == 0) { return {gbwt::Range::empty_range(), gbwt::invalid_offset(), gbwt::invalid_offset()}; }
+    if (gbwt::Range::empty(next))
+        std::tie(next, nextTop, nextBot) = LongMatchesFastLCPInitializeEmptyBlock(r, l, scratch.inBlock, scratch.a[k], Qs[k], g.nodeSize(Qs[k]), scratch.s[k],
+                scratch.lcpa[k], scratch.lcpb[k], Qs.size(), k, t, filter);
+    return LongMatchesExpandNonEmptyBlock(r, l, scratch.inBlock, g.nodeSize(Qs[k]), next, nextTop, nextBot, Qs.size(), k, t, hot, Qs[k], filter);
+}
 #endif //GBWT_QUERY_QUERYSUPPORT_H
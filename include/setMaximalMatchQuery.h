@@ -27,6 +27,7 @@ SOFTWARE.
 #define GBWT_QUERY_SETMAXIMALMATCHQUERY_H
 
 #include<querySupport.h>
+#include<fast_rlcp.h>
 #include<vector>
 #include<algorithm>
 #include<exception>
@@ -180,190 +181,370 @@ setMaximalMatchQuery1(const gbwt::GBWT & x, const gbwt::FastLocate & r, const gb
     std::vector<gbwt::size_type> lcpa, lcpb;
     std::tie(lcpa, lcpb) = lcpAboveBelowGBWT(x, a, Qs);
     
-    //output set maximal matches
+    //output set maximal matches, consecutive matches slide along Q so each is searched from scratch (dropping the first searched node
+    //of a search state needs the lcps of FastLCP), but the length of each matched path is found once
+    std::unordered_map<gbwt::size_type,gbwt::size_type> pathLengths;
     gbwt::size_type prev = 0, len;
     for (gbwt::size_type k = 0; k < Qs.size(); ++k){
         len = std::max(lcpa[k], lcpb[k]);
         if (len >= prev)
-            AddMatchesFastLocate(x, r, Q, Q.size()-k-len, len, matches);
+            AddMatchesFastLocate(x, r, Q, Q.size()-k-len, len, matches, pathLengths);
         prev = len;
     }
     return matches;
 }
 
-std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-setMaximalMatchQuery2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q){
+//set maximal matches of Q on any index (see IndexTraits) with the buffers in scratch, matches are written to matches 
+//(a vector or callable, see emitMatch). The lcps are compared on ct if it is given and walked otherwise, see queryLcps.
+//Versions 2, 3, 4, and 2_4 are this query on gbwt::GBWT and lf_gbwt::GBWT, without and with ct
+//r and l are a gbwt::FastLocate and a FastLCP, or one FastRLCP for both without ct
+template<class Index, class Locate, class LCPs, class Sink>
+void setMaximalMatchQueryT(const Index& g, const Locate& r, const LCPs& l, const CompText* ct, const gbwt::vector_type& Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
     for (gbwt::node_type a : Q)
-        if (!x.contains(a) || x.nodeSize(a) == 0)
-            return {};
-    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!x.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
-
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return;
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size()) { return; }
 
     //compute virtual insertion positions
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffGBWT(x, r, l, Qs);
-    //std::cout << "a: " ;
-    //for (auto x : a)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "s: " ;
-    //for (auto x : s)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+    const gbwt::vector_type& Qs = scratch.Qs;
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s, & lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
 
     //compute lcps
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowGBWT(x, a, Qs);
-    //std::cout << "lcpa: " ;
-    //for (auto x : lcpa)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "lcpb: " ;
-    //for (auto x : lcpb)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+    queryLcps(g, l, ct, scratch);
 
     //output set maximal matches
     gbwt::size_type prev = 0, len;
     for (gbwt::size_type k = 0; k < Qs.size(); ++k){
         len = std::max(lcpa[k], lcpb[k]);
         if (len >= prev){
-            AddMatchesFastLCP(x, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], matches);
+            AddMatchesFastLCP(g, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], matches, hot);
         }
         prev = len;
     }
+}
+
+//setMaximalMatchQuery2 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void setMaximalMatchQuery2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryT(x, r, l, nullptr, Q, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQuery2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQuery2(x, r, l, Q, scratch, matches, hot);
     return matches;
 }
 
+//setMaximalMatchQuery3 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void setMaximalMatchQuery3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryT(lfg, r, l, nullptr, Q, scratch, matches, hot);
+}
+
 std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-setMaximalMatchQuery3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q){
-    //std::cout << "In setMaximalMatchQuery3" << std::endl;
-    for (gbwt::node_type a : Q)
-        if (!lfg.contains(a) || lfg.nodeSize(a) == 0)
-            return {};
+setMaximalMatchQuery3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
     std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+    setMaximalMatchQuery3(lfg, r, l, Q, scratch, matches, hot);
+    return matches;
+}
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
+//setMaximalMatchQuery3 on the interleaved samples of rl alone, see FastRLCP
+template<class Sink>
+void setMaximalMatchQuery3(const lf_gbwt::GBWT & lfg, const FastRLCP & rl, const gbwt::vector_type & Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryT(lfg, rl, rl, nullptr, Q, scratch, matches, hot);
+}
 
-    //compute virtual insertion positions
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffLFGBWT(lfg, r, l, Qs);
-    //std::cout << "a: " ;
-    //for (auto x : a)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "s: " ;
-    //for (auto x : s)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQuery3(const lf_gbwt::GBWT & lfg, const FastRLCP & rl, const gbwt::vector_type & Q, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQuery3(lfg, rl, Q, scratch, matches, hot);
+    return matches;
+}
 
-    //compute lcps
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowLFGBWT(lfg, a, Qs);
-    //std::cout << "lcpa: " ;
-    //for (auto x : lcpa)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "lcpb: " ;
-    //for (auto x : lcpb)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+//setMaximalMatchQuery4 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void setMaximalMatchQuery4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryT(lfg, r, l, &ct, Q, scratch, matches, hot);
+}
 
-    //output set maximal matches
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQuery4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQuery4(lfg, r, l, ct, Q, scratch, matches, hot);
+    return matches;
+}
+
+//setMaximalMatchQuery2_4 with the buffers in scratch, matches are written to matches (a vector or callable, see emitMatch)
+template<class Sink>
+void setMaximalMatchQuery2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryT(x, r, l, &ct, Q, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQuery2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQuery2_4(x, r, l, ct, Q, scratch, matches, hot);
+    return matches;
+}
+
+//------------------------------------------------------------------------------
+//Set maximal matches leaving out sequences
+
+//writes the set maximal matches of Q among the members of remaining, computed from lcpa and lcpb against every sequence,
+//so queries of indexed haplotypes against the rest (see excludingSequences) need no index without them, see leaveOutLcps
+//add(k, len, sink) locates the matches of length len at position k of Qs
+//Remaining is an ExcludedSequences, a HaplotypeFilter, or any filter of FilteredSink
+template<class Index, class Remaining, class Sink, class Add>
+void addLeaveOutSetMaximalMatches(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const Remaining& remaining, 
+        QueryScratch& scratch, Sink& matches, Add add) {
+    leaveOutLcps(g, r, l, remaining, scratch.a, scratch.s, scratch.Qs, scratch.lcpa, scratch.lcpb);
+    auto sink = filterMatches(remaining, matches);
+    //a node of Qs without members has no match, so len is 0 inside Qs, not only at the endmarker
     gbwt::size_type prev = 0, len;
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k){
-        len = std::max(lcpa[k], lcpb[k]);
-        if (len >= prev){
-            AddMatchesFastLCPLFGBWT(lfg, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], matches);
-        }
+    for (gbwt::size_type k = 0; k < scratch.Qs.size(); ++k){
+        len = std::max(scratch.lcpa[k], scratch.lcpb[k]);
+        if (len != 0 && len >= prev)
+            add(k, len, sink);
         prev = len;
     }
-    //std::cout << "Leaving setMaximalMatchQuery3" << std::endl;
+}
+
+//setMaximalMatchQueryT as if only the members of remaining were in the index, see addLeaveOutSetMaximalMatches
+template<class Index, class Remaining, class Sink>
+void setMaximalMatchQueryExcludingT(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::vector_type& Q, const Remaining& remaining, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    for (gbwt::node_type a : Q)
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return;
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size()) { return; }
+
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s, & lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    queryLcps(g, l, ct, scratch);
+    addLeaveOutSetMaximalMatches(g, r, l, remaining, scratch, matches, [&] (gbwt::size_type k, gbwt::size_type len, auto& sink) {
+            AddMatchesFastLCP(g, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], sink, hot);
+            });
+}
+
+//set maximal matches of version 2 as if only the members of remaining were in the index, see addLeaveOutSetMaximalMatches
+template<class Remaining, class Sink>
+void setMaximalMatchQueryExcluding2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const Remaining& remaining, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryExcludingT(x, r, l, nullptr, Q, remaining, scratch, matches, hot);
+}
+
+template<class Remaining>
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryExcluding2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const Remaining& remaining, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryExcluding2(x, r, l, Q, remaining, scratch, matches, hot);
     return matches;
 }
 
+//set maximal matches of version 3 as if only the members of remaining were in the index, see addLeaveOutSetMaximalMatches
+template<class Remaining, class Sink>
+void setMaximalMatchQueryExcluding3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const Remaining& remaining, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryExcludingT(lfg, r, l, nullptr, Q, remaining, scratch, matches, hot);
+}
+
+template<class Remaining>
 std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-setMaximalMatchQuery4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q){
-    //std::cout << "In setMaximalMatchQuery4" << std::endl;
-    for (gbwt::node_type a : Q)
-        if (!lfg.contains(a) || lfg.nodeSize(a) == 0)
-            return {};
+setMaximalMatchQueryExcluding3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const Remaining& remaining, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
     std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!lfg.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+    setMaximalMatchQueryExcluding3(lfg, r, l, Q, remaining, scratch, matches, hot);
+    return matches;
+}
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
+//set maximal matches of version 4 as if only the members of remaining were in the index, see addLeaveOutSetMaximalMatches
+template<class Remaining, class Sink>
+void setMaximalMatchQueryExcluding4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q, const Remaining& remaining, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryExcludingT(lfg, r, l, &ct, Q, remaining, scratch, matches, hot);
+}
 
-    //std::cout << "Starting virtual insertion" << std::endl;
-    //compute virtual insertion positions
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffLFGBWT(lfg, r, l, Qs);
-    //std::cout << "Finished virtual insertion, starting LCPs" << std::endl;
-    //std::cout << "a: " ;
-    //for (auto x : a)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "s: " ;
-    //for (auto x : s)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+template<class Remaining>
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryExcluding4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q, const Remaining& remaining, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryExcluding4(lfg, r, l, ct, Q, remaining, scratch, matches, hot);
+    return matches;
+}
 
-    //compute lcps
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowCT(lfg, l, ct, a, s, Qs);
-    //std::cout << "Finished LCPs, starting set maximal matches" << std::endl;
-    //std::cout << "lcpa: " ;
-    //for (auto x : lcpa)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
-    //std::cout << "lcpb: " ;
-    //for (auto x : lcpb)
-        //std::cout << x << ' ';
-    //std::cout << std::endl;
+//set maximal matches of version 2_4 as if only the members of remaining were in the index, see addLeaveOutSetMaximalMatches
+template<class Remaining, class Sink>
+void setMaximalMatchQueryExcluding2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q, const Remaining& remaining, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryExcludingT(x, r, l, &ct, Q, remaining, scratch, matches, hot);
+}
 
-    //output set maximal matches
+template<class Remaining>
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryExcluding2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q, const Remaining& remaining, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryExcluding2_4(x, r, l, ct, Q, remaining, scratch, matches, hot);
+    return matches;
+}
+
+//------------------------------------------------------------------------------
+//Top k set maximal matches
+
+//calls add(k, len, sink) for the positions k of Qs that end set maximal matches of length len, longest first, 
+//until at least topK matches are written to matches, every match of the last length is written, 
+//so matches are exactly the set maximal matches at least as long as the topK-th longest one
+//shorter matches are never located, candidates is a buffer
+template<class Sink, class Add>
+void addTopKSetMaximalMatches(const std::vector<gbwt::size_type>& lcpa, const std::vector<gbwt::size_type>& lcpb, const gbwt::size_type topK, 
+        std::vector<gbwt::size_type>& candidates, Sink& matches, Add add) {
+    auto length = [&lcpa, &lcpb] (gbwt::size_type k) { return std::max(lcpa[k], lcpb[k]); };
+    candidates.clear();
     gbwt::size_type prev = 0, len;
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k){
-        len = std::max(lcpa[k], lcpb[k]);
-        if (len >= prev){
-            AddMatchesFastLCPLFGBWT(lfg, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], matches);
-        }
+    for (gbwt::size_type k = 0; k < lcpa.size(); ++k){
+        len = length(k);
+        if (len >= prev)
+            candidates.push_back(k);
         prev = len;
     }
-    //std::cout << "Leaving setMaximalMatchQuery4" << std::endl;
+    std::stable_sort(candidates.begin(), candidates.end(), [&length] (gbwt::size_type a, gbwt::size_type b) { return length(a) > length(b); });
+
+    gbwt::size_type written = 0, last = 0;
+    auto counted = [&matches, &written] (gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) {
+        ++written;
+        emitMatch(matches, start, len, path, pathStart);
+    };
+    for (gbwt::size_type k : candidates) {
+        len = length(k);
+        if (written >= topK && len < last) { break; }
+        add(k, len, counted);
+        last = len;
+    }
+}
+
+//setMaximalMatchQueryT restricted to the matches at least as long as the topK-th longest, see addTopKSetMaximalMatches
+template<class Index, class Sink>
+void setMaximalMatchQueryTopKT(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::vector_type& Q, const gbwt::size_type topK, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    for (gbwt::node_type a : Q)
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return;
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size() || topK == 0) { return; }
+
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+    const std::vector<gbwt::size_type>& a = scratch.a, & s = scratch.s, & lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    queryLcps(g, l, ct, scratch);
+    addTopKSetMaximalMatches(lcpa, lcpb, topK, scratch.candidates, matches, [&] (gbwt::size_type k, gbwt::size_type len, auto& sink) {
+            AddMatchesFastLCP(g, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], sink, hot);
+            });
+}
+
+//set maximal matches of version 2 at least as long as the topK-th longest, see addTopKSetMaximalMatches
+template<class Sink>
+void setMaximalMatchQueryTopK2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const gbwt::size_type topK, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryTopKT(x, r, l, nullptr, Q, topK, scratch, matches, hot);
+}
+
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryTopK2(const gbwt::GBWT & x, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const gbwt::size_type topK, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryTopK2(x, r, l, Q, topK, scratch, matches, hot);
     return matches;
 }
 
+//set maximal matches of version 3 at least as long as the topK-th longest, see addTopKSetMaximalMatches
+template<class Sink>
+void setMaximalMatchQueryTopK3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const gbwt::size_type topK, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryTopKT(lfg, r, l, nullptr, Q, topK, scratch, matches, hot);
+}
+
 std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
-setMaximalMatchQuery2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q){
-    for (gbwt::node_type a : Q)
-        if (!x.contains(a) || x.nodeSize(a) == 0)
-            return {};
+setMaximalMatchQueryTopK3(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate &r, const FastLCP & l, const gbwt::vector_type & Q, const gbwt::size_type topK, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
     std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
-    if (!x.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
-    if (!Q.size()) { return matches; }
+    setMaximalMatchQueryTopK3(lfg, r, l, Q, topK, scratch, matches, hot);
+    return matches;
+}
 
-    gbwt::vector_type Qs = reverseAndAppendENDMARKER(Q);
+//set maximal matches of version 4 at least as long as the topK-th longest, see addTopKSetMaximalMatches
+template<class Sink>
+void setMaximalMatchQueryTopK4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q, const gbwt::size_type topK, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryTopKT(lfg, r, l, &ct, Q, topK, scratch, matches, hot);
+}
 
-    std::vector<gbwt::size_type> a, s;
-    std::tie(a, s) = virtualInsertionWithSuffGBWT(x, r, l, Qs);
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryTopK4(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type & Q, const gbwt::size_type topK, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryTopK4(lfg, r, l, ct, Q, topK, scratch, matches, hot);
+    return matches;
+}
 
-    std::vector<gbwt::size_type> lcpa, lcpb;
-    std::tie(lcpa, lcpb) = lcpAboveBelowCT(x, l, ct, a, s, Qs);
+//set maximal matches of version 2_4 at least as long as the topK-th longest, see addTopKSetMaximalMatches
+template<class Sink>
+void setMaximalMatchQueryTopK2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q, const gbwt::size_type topK, QueryScratch& scratch, Sink& matches, const HotNodeCache* hot = nullptr){
+    setMaximalMatchQueryTopKT(x, r, l, &ct, Q, topK, scratch, matches, hot);
+}
 
-    gbwt::size_type prev = 0, len;
-    for (gbwt::size_type k = 0; k < Qs.size(); ++k){
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchQueryTopK2_4(const gbwt::GBWT & x, const gbwt::FastLocate& r, const FastLCP& l, const CompText & ct, const gbwt::vector_type & Q, const gbwt::size_type topK, const HotNodeCache* hot = nullptr){
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    setMaximalMatchQueryTopK2_4(x, r, l, ct, Q, topK, scratch, matches, hot);
+    return matches;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//Set maximal match counts
+
+//(start position in Q, length, number of occurrences in the paths) of every set maximal match of Q, in order of start, written to counts
+//the rows of node Qs[k] sharing the longest prefix len_k = max(lcpa[k], lcpb[k]) with Qs[k..] are kept as a long match block of
+//threshold len_k, stepped from the block at k+1 (len_k <= len_{k+1}+1, see countBlockStep), and the size of the block is the count
+//of the match, so only the suffixes at the edges of the blocks are located. The lcps are as in setMaximalMatchQueryT
+template<class Index>
+void setMaximalMatchCountQueryT(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::vector_type& Q, QueryScratch& scratch,
+        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>& counts, const HotNodeCache* hot = nullptr) {
+    for (gbwt::node_type a : Q)
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return;
+    if (!g.bidirectional()) { throw std::invalid_argument("Input GBWT must be bidirectional!"); }
+    if (!Q.size()) { return; }
+
+    virtualInsertionWithSuff(g, r, l, Q, scratch);
+    const std::vector<gbwt::size_type>& lcpa = scratch.lcpa, & lcpb = scratch.lcpb;
+    queryLcps(g, l, ct, scratch);
+
+    gbwt::range_type block = gbwt::Range::empty_range();
+    gbwt::size_type topSuff = gbwt::invalid_offset(), botSuff = gbwt::invalid_offset(), len, prev;
+    scratch.inBlock.clear();
+    for (gbwt::size_type k = scratch.Qs.size()-1; k-- != 0;){
         len = std::max(lcpa[k], lcpb[k]);
-        if (len >= prev){
-            AddMatchesFastLCP(x, r, l, Q, Q.size()-k-len, len, a[k], s[k], lcpa[k], lcpb[k], matches);
-        }
-        prev = len;
+        std::tie(block, topSuff, botSuff) = countBlockStep(g, r, l, scratch, k, len, block, topSuff, botSuff, hot);
+        //the blocks are stepped from the end of Qs, so the lcps at k-1 are read ahead
+        prev = (k == 0)? 0 : std::max(lcpa[k-1], lcpb[k-1]);
+        if (len != 0 && len >= prev)
+            counts.emplace_back(Q.size()-k-len, len, gbwt::Range::length(block));
     }
-    return matches;
 }
+
+//(start position in Q, length, number of occurrences in the paths) of the set maximal matches, see setMaximalMatchCountQueryT
+//on either index, ct is optional
+template<class Index>
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+setMaximalMatchCountQuery(const Index& g, const gbwt::FastLocate& r, const FastLCP& l, const CompText* ct, const gbwt::vector_type& Q, const HotNodeCache* hot = nullptr) {
+    QueryScratch scratch;
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>> counts;
+    setMaximalMatchCountQueryT(g, r, l, ct, Q, scratch, counts, hot);
+    return counts;
+}
+//------------------------------------------------------------------------------
+
 #endif //GBWT_QUERY_SETMAXIMALMATCHQUERY_H
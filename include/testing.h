@@ -31,7 +31,18 @@ SOFTWARE.
 #include<iostream>
 #include<vector>
 #include<random>
+#include<map>
 #include<fast_lcp.h>
+#include<fast_rlcp.h>
+#include<hot_node_cache.h>
+#include<lf_locate.h>
+#include<queryEngine.h>
+#include<batchQuery.h>
+#include<onlineLongMatchQuery.h>
+#include<parallelQuery.h>
+#include<groupedMatches.h>
+#include<allVsAll.h>
+#include<queryPlanner.h>
 #include<lf_gbwt.h>
 #include<ioHelp.h>
 #include<compText.h>
@@ -39,6 +50,8 @@ SOFTWARE.
 #include<setMaximalMatchQuery.h>
 #include<longMatchQuery.h>
 #include<cstdio>
+#include<iterator>
+#include<thread>
 
 //------------------------------------------------------------------------------
 //Comparing matches
@@ -128,7 +141,103 @@ gbwt::vector_type generateHaplotype(const gbwt::GBWT & x, double mu, double thet
     return path;
 }
 
-bool queriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q){
+//set maximal match counts are the located set maximal matches in all grouped by (start position in Q, length)
+bool countQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q,
+        const std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& all, const HotNodeCache* hot = nullptr){
+    std::map<std::pair<gbwt::size_type,gbwt::size_type>,gbwt::size_type> grouped;
+    for (const auto& m : all)
+        ++grouped[{std::get<0>(m), std::get<1>(m)}];
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>> counts(1);
+    for (const auto& g : grouped)
+        counts[0].emplace_back(g.first.first, g.first.second, g.second);
+    counts.push_back(setMaximalMatchCountQuery(x, r, l, nullptr, Q));
+    counts.push_back(setMaximalMatchCountQuery(lfg, r, l, nullptr, Q, hot));
+    counts.push_back(setMaximalMatchCountQuery(lfg, r, l, &ct, Q));
+    counts.push_back(setMaximalMatchCountQuery(x, r, l, &ct, Q, hot));
+    //the counts are in order of start
+    bool sorted = true;
+    for (const auto& a : counts)
+        sorted = sorted && std::is_sorted(a.begin(), a.end());
+    return sorted && matchesAgree(counts);
+}
+
+//tagged long matches for several thresholds agree with long matches for each threshold
+bool multiLQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const std::vector<gbwt::size_type>& Ls, const gbwt::vector_type Q, const HotNodeCache* hot = nullptr){
+    std::vector<std::vector<tagged_match_type>> tagged = {longMatchQueryMultiL2(x, r, l, Ls, Q), longMatchQueryMultiL3(lfg, r, l, Ls, Q, hot), 
+        longMatchQueryMultiL4(lfg, r, l, ct, Ls, Q), longMatchQueryMultiL2_4(x, r, l, ct, Ls, Q, hot)};
+    bool overall = true;
+    for (gbwt::size_type j = 0; j < Ls.size(); ++j) {
+        std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> matches = {longMatchQuery2(x, r, l, Ls[j], Q)};
+        for (const auto& t : tagged) {
+            matches.emplace_back();
+            for (const auto& m : t) {
+                if (std::get<4>(m) > j)
+                    matches.back().emplace_back(std::get<0>(m), std::get<1>(m), std::get<2>(m), std::get<3>(m));
+                //the tag is the number of thresholds the length satisfies
+                overall = overall && (std::get<4>(m) > j) == (std::get<1>(m) >= Ls[j]);
+            }
+        }
+        for (auto& a : matches)
+            sort(a.begin(), a.end());
+        overall = overall && matchesAgree(matches);
+    }
+    return overall;
+}
+
+//long match counts are the number of located long matches in all covering each window of length L, and the windows
+//of consecutive starts with equal counts form one interval
+bool longCountQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::size_type L, const gbwt::vector_type Q,
+        const std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& all, const HotNodeCache* hot = nullptr){
+    std::map<gbwt::size_type,gbwt::size_type> windows;
+    for (const auto& m : all)
+        for (gbwt::size_type start = std::get<0>(m); start + L <= std::get<0>(m) + std::get<1>(m); ++start)
+            ++windows[start];
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>> counts(1);
+    for (const auto& w : windows) {
+        if (counts[0].size() && std::get<0>(counts[0].back()) + std::get<1>(counts[0].back()) + 1 == w.first + L && std::get<2>(counts[0].back()) == w.second)
+            ++std::get<1>(counts[0].back());
+        else
+            counts[0].emplace_back(w.first, L, w.second);
+    }
+    counts.push_back(longMatchCountQuery(x, r, l, nullptr, L, Q));
+    counts.push_back(longMatchCountQuery(lfg, r, l, nullptr, L, Q, hot));
+    counts.push_back(longMatchCountQuery(lfg, r, l, &ct, L, Q));
+    counts.push_back(longMatchCountQuery(x, r, l, &ct, L, Q, hot));
+    //the block size of a window is the number of its occurrences
+    bool overall = true;
+    for (const auto& w : windows)
+        overall = overall && countOccurrences(x, Q, w.first, w.first + L) == w.second;
+    return overall && matchesAgree(counts);
+}
+
+//top k queries return the matches of all at least as long as the k-th longest one
+bool topKQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q,
+        const std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>& all, const HotNodeCache* hot = nullptr){
+    std::vector<gbwt::size_type> lengths;
+    for (const auto& m : all)
+        lengths.push_back(std::get<1>(m));
+    std::sort(lengths.begin(), lengths.end(), std::greater<gbwt::size_type>());
+    bool overall = true;
+    QueryEngine engine3(lfg, r, l, nullptr, hot);
+    for (gbwt::size_type topK : {gbwt::size_type(1), gbwt::size_type(2), all.size()/2 + 1, all.size() + 1}) {
+        std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> matches(1);
+        for (const auto& m : all)
+            if (topK > lengths.size() || std::get<1>(m) >= lengths[topK-1])
+                matches[0].push_back(m);
+        matches.push_back(setMaximalMatchQueryTopK2(x, r, l, Q, topK));
+        matches.push_back(setMaximalMatchQueryTopK3(lfg, r, l, Q, topK, hot));
+        matches.push_back(setMaximalMatchQueryTopK4(lfg, r, l, ct, Q, topK));
+        matches.push_back(setMaximalMatchQueryTopK2_4(x, r, l, ct, Q, topK, hot));
+        matches.push_back(engine3.topKSetMaximalMatches(Q, topK));
+        for (auto& a : matches)
+            sort(a.begin(), a.end());
+        overall = overall && matchesAgree(matches);
+    }
+    return overall;
+}
+
+//rl, if given, is the FastRLCP of l and version 3 is also run on it alone
+bool queriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q, const HotNodeCache* hot = nullptr, const FastRLCP* rl = nullptr){
     //(start position in Q, length, path ID)
     std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type>>>                 matchWithoutPosition = {setMaximalMatchQueryN2(x,Q), setMaximalMatchQuery0(x,Q)};
     //(start position in Q, length, path ID, start position in path)
@@ -138,24 +247,87 @@ bool queriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLC
     matchWithPosition.push_back(setMaximalMatchQuery3(lfg, r, l, Q));
     matchWithPosition.push_back(setMaximalMatchQuery4(lfg, r, l, ct, Q));
     matchWithPosition.push_back(setMaximalMatchQuery2_4(x, r, l, ct, Q));
+    QueryEngine engine2(x, r, l), engine4(lfg, r, l, &ct, hot);
+    matchWithPosition.push_back(engine2.setMaximalMatches(Q));
+    matchWithPosition.push_back(engine4.setMaximalMatches(Q));
+    {
+        //matches streamed to a callable sink
+        std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> streamed;
+        auto sink = [&streamed] (gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) { streamed.emplace_back(start, len, path, pathStart); };
+        QueryScratch scratch;
+        setMaximalMatchQuery3(lfg, r, l, Q, scratch, sink);
+        matchWithPosition.push_back(streamed);
+    }
+    if (hot) {
+        matchWithPosition.push_back(setMaximalMatchQuery2(x, r, l, Q, hot));
+        matchWithPosition.push_back(setMaximalMatchQuery4(lfg, r, l, ct, Q, hot));
+    }
+    if (rl) {
+        matchWithPosition.push_back(setMaximalMatchQuery3(lfg, *rl, Q));
+        matchWithPosition.push_back(setMaximalMatchQuery3(lfg, *rl, Q, hot));
+    }
     for (auto& a : matchWithoutPosition)
         sort(a.begin(), a.end());
     for (auto& a : matchWithPosition)
         sort(a.begin(), a.end());
     return matchesAgree(matchWithoutPosition) 
         && matchesAgree(matchWithPosition) 
-        && matchesAgree(matchWithoutPosition[0], matchWithPosition[0]);
+        && matchesAgree(matchWithoutPosition[0], matchWithPosition[0])
+        && topKQueriesEqual(x, r, l, lfg, ct, Q, matchWithPosition[0], hot)
+        && countQueriesEqual(x, r, l, lfg, ct, Q, matchWithPosition[0], hot);
 }
 
-bool longMatchQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q, std::mt19937_64& gen, const gbwt::size_type maxTests){
+//long matches of Q found by OnlineLongMatchQuery reading Q in random chunks, none if a node of Q is not in g like longMatchQuery2 and 3
+//only the matches on members of filter if it is given
+template<class Index>
+std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>
+onlineLongMatches(const Index& g, const gbwt::FastLocate & r, const FastLCP & l, const gbwt::size_type L, const gbwt::vector_type& Q, std::mt19937_64& gen, const HotNodeCache* hot = nullptr, const HaplotypeFilter* filter = nullptr){
+    std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> matches;
+    for (gbwt::node_type a : Q)
+        if (!g.contains(a) || g.nodeSize(a) == 0)
+            return matches;
+    OnlineLongMatchQuery<Index> online(g, r, l, L, hot);
+    std::uniform_int_distribution<gbwt::size_type> chunkSize(1, 1 + Q.size()/3);
+    auto read = [&] (auto& sink) {
+        for (gbwt::size_type start = 0, end; start < Q.size(); start = end) {
+            end = std::min<gbwt::size_type>(Q.size(), start + chunkSize(gen));
+            online.append(gbwt::vector_type(Q.begin() + start, Q.begin() + end), sink);
+        }
+        online.finish(sink);
+    };
+    if (filter) {
+        auto sink = filterMatches(*filter, matches);
+        read(sink);
+    }
+    else { read(matches); }
+    return matches;
+}
+
+bool longMatchQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q, std::mt19937_64& gen, const gbwt::size_type maxTests, const HotNodeCache* hot = nullptr){
     std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> LongMatches;
     gbwt::size_type i = 1;
     bool agree, overall = true;
+    //engines are reused across queries
+    QueryEngine engine2_4(x, r, l, &ct), engine3(lfg, r, l, nullptr, hot);
     do {
         LongMatches  = {longMatchQueryBrute(x, i, Q), longMatchQuery2(x, r, l, i, Q), longMatchQuery3(lfg, r, l, i, Q), longMatchQuery4(lfg, r, l, ct, i, Q), longMatchQuery2_4(x, r, l, ct, i, Q)};
+        LongMatches.push_back(engine2_4.longMatches(i, Q));
+        LongMatches.push_back(engine3.longMatches(i, Q));
+        LongMatches.push_back(onlineLongMatches(x, r, l, i, Q, gen));
+        LongMatches.push_back(onlineLongMatches(lfg, r, l, i, Q, gen, hot));
+        {
+            std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> streamed;
+            auto sink = [&streamed] (gbwt::size_type start, gbwt::size_type len, gbwt::size_type path, gbwt::size_type pathStart) { streamed.emplace_back(start, len, path, pathStart); };
+            engine2_4.longMatches(i, Q, sink);
+            LongMatches.push_back(streamed);
+        }
+        if (hot) {
+            LongMatches.push_back(longMatchQuery2(x, r, l, i, Q, hot));
+            LongMatches.push_back(longMatchQuery3(lfg, r, l, i, Q, hot));
+        }
         for (auto& a : LongMatches)
             sort(a.begin(), a.end());
-        agree = matchesAgree(LongMatches);
+        agree = matchesAgree(LongMatches) && longCountQueriesEqual(x, r, l, lfg, ct, i, Q, LongMatches[0], hot);
         overall = overall && agree;
         i *= 2;
     } while (LongMatches[0].size());
@@ -165,14 +337,202 @@ bool longMatchQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, con
         gbwt::size_type L = dis(gen);
         std::cout << "L = " << L << std::endl;
         LongMatches  = {longMatchQueryBrute(x, L, Q), longMatchQuery2(x, r, l, L, Q), longMatchQuery3(lfg, r, l, L, Q), longMatchQuery4(lfg, r, l, ct, L, Q), longMatchQuery2_4(x, r, l, ct, L, Q)};
+        LongMatches.push_back(engine2_4.longMatches(L, Q));
+        LongMatches.push_back(engine3.longMatches(L, Q));
+        LongMatches.push_back(onlineLongMatches(x, r, l, L, Q, gen));
+        LongMatches.push_back(onlineLongMatches(lfg, r, l, L, Q, gen, hot));
+        if (hot) {
+            LongMatches.push_back(longMatchQuery2(x, r, l, L, Q, hot));
+            LongMatches.push_back(longMatchQuery3(lfg, r, l, L, Q, hot));
+        }
         for (auto& a : LongMatches)
             sort(a.begin(), a.end());
-        agree = matchesAgree(LongMatches);
+        agree = matchesAgree(LongMatches) && longCountQueriesEqual(x, r, l, lfg, ct, L, Q, LongMatches[0], hot) && multiLQueriesEqual(x, r, l, lfg, ct, {L, L+1, 2*L}, Q, hot);
         overall = overall && agree;
     }
     return overall;
 }
 
+//versions 3 and 4 on structures that only have the header of the gbwt agree with versions 3 and 4 on the full structures
+bool lfLocateQueriesEqual(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type Q, const gbwt::size_type L){
+    LFLocate lfl(lfg, r, l, ct);
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> setMaximal = {
+        setMaximalMatchQuery3(lfg, r, l, Q), setMaximalMatchQuery3(lfg, lfl.r, lfl.l, Q), setMaximalMatchQuery4(lfg, lfl.r, lfl.l, lfl.ct, Q)};
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> longMatch = {
+        longMatchQuery3(lfg, r, l, L, Q), longMatchQuery3(lfg, lfl.r, lfl.l, L, Q), longMatchQuery4(lfg, lfl.r, lfl.l, lfl.ct, L, Q)};
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatch)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatch);
+}
+
+//batch queries deliver every query once in input order with the matches of the individual queries,
+//both with one query per task and with groups of queries that share the virtual insertion of common prefixes
+//versions 3 and 4 split into segments agree with the sequential queries, including one segment per position of Qs
+bool parallelQueriesEqual(const lf_gbwt::GBWT & lfg, const gbwt::FastLocate & r, const FastLCP & l, const CompText & ct, const gbwt::vector_type Q, const gbwt::size_type L, const HotNodeCache* hot = nullptr){
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> setMaximal = {setMaximalMatchQuery3(lfg, r, l, Q)}, 
+        longMatches = {longMatchQuery3(lfg, r, l, L, Q)};
+    for (gbwt::size_type segments : {gbwt::size_type(0), gbwt::size_type(2), gbwt::size_type(3), Q.size() + 1}) {
+        setMaximal.push_back(setMaximalMatchQueryParallel3(lfg, r, l, Q, segments, hot));
+        setMaximal.push_back(setMaximalMatchQueryParallel4(lfg, r, l, ct, Q, segments));
+        longMatches.push_back(longMatchQueryParallel3(lfg, r, l, L, Q, segments, hot));
+        longMatches.push_back(longMatchQueryParallel4(lfg, r, l, ct, L, Q, segments));
+    }
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatches)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatches);
+}
+
+//queries writing to a FilteredSink agree with the matches of the full queries on the members of filter
+bool filteredQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const HaplotypeFilter& filter, 
+        const gbwt::vector_type Q, const gbwt::size_type L, std::mt19937_64& gen, const HotNodeCache* hot = nullptr){
+    typedef std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> Matches;
+    auto members = [&filter] (Matches matches) {
+        matches.erase(std::remove_if(matches.begin(), matches.end(), [&filter] (const std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>& m) { return !filter.contains(std::get<2>(m)); }), matches.end());
+        return matches;
+    };
+    std::vector<Matches> setMaximal = {members(setMaximalMatchQuery3(lfg, r, l, Q))}, longMatches = {members(longMatchQuery3(lfg, r, l, L, Q))};
+    QueryScratch scratch;
+    for (int version = 0; version < 4; ++version) {
+        Matches setMaximalFiltered, longFiltered;
+        auto setMaximalSink = filterMatches(filter, setMaximalFiltered);
+        auto longSink = filterMatches(filter, longFiltered);
+        switch (version) {
+            case 0: setMaximalMatchQuery2(x, r, l, Q, scratch, setMaximalSink, hot); longMatchQuery2(x, r, l, L, Q, scratch, longSink, hot); break;
+            case 1: setMaximalMatchQuery3(lfg, r, l, Q, scratch, setMaximalSink, hot); longMatchQuery3(lfg, r, l, L, Q, scratch, longSink, hot); break;
+            case 2: setMaximalMatchQuery4(lfg, r, l, ct, Q, scratch, setMaximalSink); longMatchQuery4(lfg, r, l, ct, L, Q, scratch, longSink); break;
+            default: setMaximalMatchQueryParallel3(lfg, r, l, Q, 2, scratch, setMaximalSink, hot); longMatchQueryParallel4(lfg, r, l, ct, L, Q, 3, scratch, longSink); break;
+        }
+        setMaximal.push_back(setMaximalFiltered);
+        longMatches.push_back(longFiltered);
+    }
+    longMatches.push_back(onlineLongMatches(lfg, r, l, L, Q, gen, hot, &filter));
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatches)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatches);
+}
+
+//Q with nodes that are not in x inserted, queried by engines that split at unknown nodes, agrees with the queries
+//of the known segments with start positions in Q
+bool splitQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q, 
+        const gbwt::size_type L, std::mt19937_64& gen, const HotNodeCache* hot = nullptr){
+    typedef std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> Matches;
+    gbwt::vector_type split;
+    for (gbwt::size_type i = 0; i <= Q.size(); ++i) {
+        if (gen() % 8 == 0)
+            split.push_back((gen() % 2)? gbwt::ENDMARKER : x.sigma() + gen() % 4);
+        if (i < Q.size())
+            split.push_back(Q[i]);
+    }
+    std::vector<Matches> setMaximal(1), longMatches(1);
+    for (gbwt::size_type start = 0, end; start < split.size(); start = end + 1) {
+        for (end = start; end < split.size() && split[end] != gbwt::ENDMARKER && x.contains(split[end]) && x.nodeSize(split[end]); ++end) {}
+        if (start == end)
+            continue;
+        gbwt::vector_type segment(split.begin() + start, split.begin() + end);
+        for (const auto& m : setMaximalMatchQuery3(lfg, r, l, segment))
+            setMaximal[0].emplace_back(std::get<0>(m) + start, std::get<1>(m), std::get<2>(m), std::get<3>(m));
+        for (const auto& m : longMatchQuery3(lfg, r, l, L, segment))
+            longMatches[0].emplace_back(std::get<0>(m) + start, std::get<1>(m), std::get<2>(m), std::get<3>(m));
+    }
+    QueryEngine engine2(x, r, l), engine2_4(x, r, l, &ct, hot), engine3(lfg, r, l, nullptr, hot), engine4(lfg, r, l, &ct);
+    for (QueryEngine* engine : {&engine2, &engine2_4, &engine3, &engine4}) {
+        engine->splitAtUnknownNodes(true);
+        setMaximal.push_back(engine->setMaximalMatches(split));
+        longMatches.push_back(engine->longMatches(L, split));
+    }
+    {
+        Matches streamed;
+        QueryScratch scratch;
+        forEachKnownSegment(lfg, split, scratch, streamed, [&] (const gbwt::vector_type& segment, QueryScratch& scratch, OffsetSink<Matches>& matches) {
+            setMaximalMatchQuery4(lfg, r, l, ct, segment, scratch, matches);
+        });
+        setMaximal.push_back(streamed);
+    }
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatches)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatches);
+}
+
+bool batchQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const std::vector<gbwt::vector_type>& queries, const gbwt::size_type L){
+    std::vector<std::vector<QueryEngine::match_type>> single2, single4;
+    for (const auto& Q : queries) {
+        single2.push_back(setMaximalMatchQuery2(x, r, l, Q));
+        single4.push_back(setMaximalMatchQuery4(lfg, r, l, ct, Q));
+    }
+    for (const auto& Q : queries) {
+        single2.push_back(longMatchQuery2(x, r, l, L, Q));
+        single4.push_back(longMatchQuery4(lfg, r, l, ct, L, Q));
+    }
+    bool overall = true;
+    for (gbwt::size_type groupSize : {1, 3}) {
+        QueryEngine engine2(x, r, l), engine4(lfg, r, l, &ct);
+        for (QueryEngine* engine : {&engine2, &engine4}) {
+            std::vector<std::vector<QueryEngine::match_type>> single = (engine == &engine2)? single2 : single4, batch;
+            gbwt::size_type expected = 0;
+            auto deliver = [&] (gbwt::size_type i, const std::vector<QueryEngine::match_type>& matches) {
+                if (i != expected % queries.size()) { overall = false; }
+                ++expected;
+                batch.push_back(matches);
+            };
+            batchSetMaximalMatch(*engine, queries, deliver, groupSize);
+            batchLongMatch(*engine, L, queries, deliver, groupSize);
+            overall = overall && single.size() == batch.size();
+            for (gbwt::size_type i = 0; overall && i < single.size(); ++i) {
+                sort(single[i].begin(), single[i].end());
+                sort(batch[i].begin(), batch[i].end());
+                overall = single[i] == batch[i];
+            }
+        }
+    }
+    //more threads than when the engine was built, the batch grows the engine's scratch before its parallel region
+    {
+        QueryEngine engine4(lfg, r, l, &ct);
+        int before = omp_get_max_threads();
+        omp_set_num_threads(before + 2);
+        std::vector<std::vector<QueryEngine::match_type>> batch;
+        batchSetMaximalMatch(engine4, queries, [&batch] (gbwt::size_type, const std::vector<QueryEngine::match_type>& matches) { batch.push_back(matches); });
+        overall = overall && engine4.threadCapacity() >= gbwt::size_type(before + 2) && batch.size() == queries.size();
+        omp_set_num_threads(before);
+        for (gbwt::size_type i = 0; overall && i < queries.size(); ++i) {
+            std::vector<QueryEngine::match_type> expected = single4[i];
+            sort(expected.begin(), expected.end());
+            sort(batch[i].begin(), batch[i].end());
+            overall = expected == batch[i];
+        }
+    }
+    //std::threads all have OpenMP thread number 0, each must get its own scratch and result buffer
+    {
+        QueryEngine engine4(lfg, r, l, &ct);
+        std::vector<std::vector<std::vector<QueryEngine::match_type>>> perThread(3);
+        std::vector<std::thread> workers;
+        for (auto& results : perThread)
+            workers.emplace_back([&engine4, &queries, &results] () {
+                for (const auto& Q : queries)
+                    results.push_back(engine4.setMaximalMatches(Q));
+            });
+        for (std::thread& worker : workers)
+            worker.join();
+        overall = overall && engine4.threadCapacity() == perThread.size();
+        for (auto& results : perThread) {
+            for (gbwt::size_type i = 0; overall && i < queries.size(); ++i) {
+                std::vector<QueryEngine::match_type> expected = single4[i];
+                sort(expected.begin(), expected.end());
+                sort(results[i].begin(), results[i].end());
+                overall = expected == results[i];
+            }
+        }
+    }
+    return overall;
+}
+
 template<class T, class U>
 bool verifySerializeLoad(const std::string& tempFilename, const T& originalStructure, const U& compare) {
     std::ofstream out(tempFilename);
@@ -196,15 +556,243 @@ bool verifySerializeLoad(const std::string& tempFilename, const T& originalStruc
 }
     
 
+//one query of Q with an engine reporting both orientations agrees with the matches of reverse(Q) mirrored onto
+//the reverse paths, so querying reverse(Q) separately only repeats the hits of Q
+bool orientationQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q, 
+        const gbwt::size_type L, const HotNodeCache* hot = nullptr){
+    typedef std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> Matches;
+    gbwt::vector_type reverseQ;
+    for (gbwt::size_type i = Q.size(); i != 0; --i)
+        reverseQ.push_back(gbwt::Node::reverse(Q[i-1]));
+    //match of reverse(Q) at (start, len) on path at pathStart, as the match of Q on the reverse path in forward path coordinates
+    auto mirror = [&l, &Q] (const Matches& matches) {
+        Matches mirrored;
+        for (const auto& m : matches) {
+            gbwt::size_type start, len, path, pathStart;
+            std::tie(start, len, path, pathStart) = m;
+            gbwt::size_type reversePath = gbwt::Path::reverse(path);
+            mirrored.emplace_back(Q.size() - start - len, len, reversePath, 
+                    (gbwt::Path::is_reverse(reversePath))? pathStart : l.pathLength(path) - pathStart - len);
+        }
+        return mirrored;
+    };
+    std::vector<Matches> setMaximal = {mirror(setMaximalMatchQuery3(lfg, r, l, reverseQ))}, longMatches = {mirror(longMatchQuery3(lfg, r, l, L, reverseQ))};
+    QueryEngine engine2(x, r, l, nullptr, hot), engine4(lfg, r, l, &ct);
+    for (QueryEngine* engine : {&engine2, &engine4}) {
+        engine->reportBothOrientations(true);
+        setMaximal.push_back(engine->setMaximalMatches(Q));
+        longMatches.push_back(engine->longMatches(L, Q));
+    }
+    {
+        Matches streamed;
+        auto sink = bothOrientations(l, streamed);
+        QueryScratch scratch;
+        setMaximalMatchQuery2_4(x, r, l, ct, Q, scratch, sink);
+        setMaximal.push_back(streamed);
+    }
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatches)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatches);
+}
+
+//queries leaving out excluded agree with the brute force set maximal matches of the remaining paths and with the long
+//matches on the remaining paths, as if the index had been rebuilt without the excluded paths
+bool leaveOutQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q, 
+        const gbwt::size_type L, const std::vector<gbwt::size_type>& excluded, const HotNodeCache* hot = nullptr){
+    typedef std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> Matches;
+    ExcludedSequences remaining = excludingSequences(x.sequences(), excluded);
+    //the same set with the run and node summaries
+    std::vector<gbwt::size_type> members;
+    for (gbwt::size_type sequence = 0; sequence < x.sequences(); ++sequence)
+        if (remaining.contains(sequence))
+            members.push_back(sequence);
+    HaplotypeFilter remainingFilter(l, members);
+    //excluded paths are emptied so the remaining paths keep their ids
+    std::vector<gbwt::vector_type> paths = extractPaths(x);
+    for (gbwt::size_type sequence : excluded)
+        paths[sequence].clear();
+    //the queries have no matches if a node of Q is not in the index
+    bool known = true;
+    for (gbwt::node_type a : Q)
+        known = known && x.contains(a) && x.nodeSize(a) != 0;
+    Matches rebuilt = (known)? setMaximalMatchQueryBrute(paths, Q) : Matches();
+    Matches longRebuilt;
+    for (const auto& m : longMatchQuery3(lfg, r, l, L, Q))
+        if (remaining.contains(std::get<2>(m)))
+            longRebuilt.push_back(m);
+    std::vector<Matches> setMaximal = {rebuilt}, longMatches = {longRebuilt};
+    setMaximal.push_back(setMaximalMatchQueryExcluding2(x, r, l, Q, remaining, hot));
+    setMaximal.push_back(setMaximalMatchQueryExcluding3(lfg, r, l, Q, remaining));
+    setMaximal.push_back(setMaximalMatchQueryExcluding4(lfg, r, l, ct, Q, remaining, hot));
+    setMaximal.push_back(setMaximalMatchQueryExcluding2_4(x, r, l, ct, Q, remaining));
+    setMaximal.push_back(setMaximalMatchQueryExcluding3(lfg, r, l, Q, remainingFilter, hot));
+    QueryEngine engine3(lfg, r, l, nullptr, hot), engine2_4(x, r, l, &ct);
+    for (QueryEngine* engine : {&engine3, &engine2_4}) {
+        engine->leaveOut(&remaining);
+        setMaximal.push_back(engine->setMaximalMatches(Q));
+        longMatches.push_back(engine->longMatches(L, Q));
+        engine->leaveOut(&remainingFilter);
+        setMaximal.push_back(engine->setMaximalMatches(Q));
+        longMatches.push_back(engine->longMatches(L, Q));
+    }
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatches)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatches);
+}
+
+//queries filling GroupedMatches agree with the queries returning tuples, and the matches survive packing
+//(with and without delta encoding) and serialize/load
+bool groupedQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q,
+        const gbwt::size_type L, const std::string& tempFilename){
+    std::vector<std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>>> setMaximal = {setMaximalMatchQuery3(lfg, r, l, Q)}, 
+        longMatches = {longMatchQuery3(lfg, r, l, L, Q)};
+    GroupedMatches setMaximalGrouped, longGrouped;
+    QueryScratch scratch;
+    setMaximalMatchQuery2(x, r, l, Q, scratch, setMaximalGrouped);
+    longMatchQuery4(lfg, r, l, ct, L, Q, scratch, longGrouped);
+    setMaximal.push_back(setMaximalGrouped.expand());
+    longMatches.push_back(longGrouped.expand());
+    bool packed = true;
+    for (const GroupedMatches* grouped : {&setMaximalGrouped, &longGrouped})
+        for (bool delta : {false, true})
+            packed = packed && grouped->groups() <= grouped->size() && verifySerializeLoad(tempFilename, PackedGroupedMatches(*grouped, delta), *grouped);
+    for (auto& a : setMaximal)
+        sort(a.begin(), a.end());
+    for (auto& a : longMatches)
+        sort(a.begin(), a.end());
+    return matchesAgree(setMaximal) && matchesAgree(longMatches) && packed;
+}
+
+//allVsAll files agree with the queries of every path leaving itself out (set maximal matches) or kept to the paths with
+//larger ids (long matches), in forward path coordinates, and a job continued from a checkpoint writes the same file
+bool allVsAllEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct,
+        const gbwt::size_type L, const std::string& tempFilename){
+    typedef std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> Matches;
+    const std::string checkpoint = tempFilename + ".checkpoint";
+    std::vector<gbwt::vector_type> paths = extractPaths(x);
+    auto readFile = [&] () {
+        std::ifstream in(tempFilename, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    bool equal = true;
+    for (gbwt::size_type length : {gbwt::size_type(0), L}) {
+        std::vector<Matches> expected(lfg.sequences() / 2);
+        for (gbwt::size_type path = 0; path < expected.size(); ++path) {
+            gbwt::size_type seq = gbwt::Path::encode(path, false);
+            if (paths[seq].empty())
+                continue;
+            Matches matches = (length == 0)? 
+                setMaximalMatchQueryExcluding3(lfg, r, l, paths[seq], excludingSequences(lfg.sequences(), {seq, gbwt::Path::reverse(seq)})) 
+                : longMatchQuery3(lfg, r, l, length, paths[seq]);
+            for (auto& m : matches) {
+                if (length != 0 && gbwt::Path::id(std::get<2>(m)) <= path)
+                    continue;
+                if (gbwt::Path::is_reverse(std::get<2>(m)))
+                    std::get<3>(m) = l.pathLength(std::get<2>(m)) - std::get<3>(m) - std::get<1>(m);
+                expected[path].push_back(m);
+            }
+            sort(expected[path].begin(), expected[path].end());
+        }
+        for (const CompText* text : {(const CompText*)nullptr, &ct}) {
+            std::remove(checkpoint.c_str());
+            allVsAll(lfg, r, l, text, length, tempFilename, 3);
+            gbwt::size_type records = 0;
+            std::ifstream in(tempFilename, std::ios::binary);
+            readAllVsAll(in, [&] (gbwt::size_type seq, const PackedGroupedMatches& packed) {
+                Matches matches = packed.expand();
+                sort(matches.begin(), matches.end());
+                equal = equal && seq == gbwt::Path::encode(records, false) && matches == expected[records];
+                ++records;
+            });
+            equal = equal && records == expected.size();
+        }
+
+        //cut the file after the first record and overwrite part of the rest, as a job interrupted after its first chunk
+        std::string complete = readFile();
+        std::streamoff first = 0;
+        {
+            std::ifstream in(tempFilename, std::ios::binary);
+            gbwt::size_type seq;
+            PackedGroupedMatches packed;
+            sdsl::load(seq, in);
+            packed.load(in);
+            first = in.tellg();
+        }
+        {
+            std::ofstream out(tempFilename, std::ios::binary | std::ios::trunc);
+            out << complete.substr(0, first) << std::string((complete.size() - first) / 2, '\0');
+            std::ofstream(checkpoint) << length << ' ' << 1 << ' ' << first << '\n';
+        }
+        allVsAll(lfg, r, l, &ct, length, tempFilename, 3);
+        equal = equal && readFile() == complete;
+    }
+    std::remove(checkpoint.c_str());
+    return equal;
+}
+
+//the versions planned with every set of loaded indexes, before and after calibration, agree with version 3
+//and only versions with their indexes loaded are planned
+bool plannerQueriesEqual(const gbwt::GBWT & x, const gbwt::FastLocate & r, const FastLCP & l, const lf_gbwt::GBWT & lfg, const CompText & ct, const gbwt::vector_type Q,
+        const gbwt::size_type L, const HotNodeCache* hot = nullptr){
+    typedef std::vector<std::tuple<gbwt::size_type,gbwt::size_type,gbwt::size_type,gbwt::size_type>> Matches;
+    Matches setMaximal = setMaximalMatchQuery3(lfg, r, l, Q), longMatches = longMatchQuery3(lfg, r, l, L, Q);
+    sort(setMaximal.begin(), setMaximal.end());
+    sort(longMatches.begin(), longMatches.end());
+    std::vector<QueryPlanner> planners = {QueryPlanner(&x, &lfg, r, &l, &ct, hot), QueryPlanner(&x, nullptr, r, &l), QueryPlanner(nullptr, &lfg, r, &l, &ct), 
+        QueryPlanner(&x, nullptr, r, &l, &ct), QueryPlanner(&x, nullptr, r)};
+    QueryPlanner calibrated = planners[0], setMaximalCalibrated = planners[0];
+    calibrated.calibrate({Q, gbwt::vector_type(Q.begin(), Q.begin() + Q.size()/2)}, L);
+    setMaximalCalibrated.calibrate({Q, gbwt::vector_type(Q.begin(), Q.begin() + Q.size()/2)});
+    planners.push_back(calibrated);
+    planners.push_back(setMaximalCalibrated);
+    bool equal = calibrated.calibrated(QueryPlanner::SET_MAXIMAL) && calibrated.calibrated(QueryPlanner::LONG)
+        && !planners[0].calibrated(QueryPlanner::SET_MAXIMAL) && !planners[0].calibrated(QueryPlanner::LONG)
+        && setMaximalCalibrated.calibrated(QueryPlanner::SET_MAXIMAL) && !setMaximalCalibrated.calibrated(QueryPlanner::LONG);
+    //long matches were not timed without L, so they are still planned by the model in LF steps
+    for (unsigned v = 0; v < QueryPlanner::VERSIONS; ++v)
+        equal = equal && setMaximalCalibrated.cost(QueryPlanner::Version(v), QueryPlanner::LONG, Q.size(), L) == planners[0].cost(QueryPlanner::Version(v), QueryPlanner::LONG, Q.size(), L);
+    equal = equal && setMaximalCalibrated.plan(QueryPlanner::LONG, Q, L) == planners[0].plan(QueryPlanner::LONG, Q, L);
+    //before calibration shorter thresholds keep long match blocks open longer
+    for (unsigned v = 0; v < QueryPlanner::VERSIONS; ++v)
+        equal = equal && planners[0].cost(QueryPlanner::Version(v), QueryPlanner::LONG, Q.size(), 1) >= planners[0].cost(QueryPlanner::Version(v), QueryPlanner::LONG, Q.size(), L);
+    for (const QueryPlanner& planner : planners) {
+        Matches planned = planner.setMaximalMatches(Q);
+        sort(planned.begin(), planned.end());
+        equal = equal && planned == setMaximal && planner.available(planner.plan(QueryPlanner::SET_MAXIMAL, Q), QueryPlanner::SET_MAXIMAL);
+        //long matches need the FastLCP
+        if (!planner.available(QueryPlanner::V1, QueryPlanner::SET_MAXIMAL)) {
+            planned = planner.longMatches(L, Q);
+            sort(planned.begin(), planned.end());
+            equal = equal && planned == longMatches && planner.available(planner.plan(QueryPlanner::LONG, Q, L), QueryPlanner::LONG);
+        }
+    }
+    return equal;
+}
+
 //Testing Queries through incremental GBWT building and querying
 bool testIncremental(gbwt::GBWT & x, gbwt::FastLocate & r, FastLCP & l, lf_gbwt::GBWT & lfg, CompText & ct, unsigned n){
     bool overall = true, result, longResult, indexes = true;
     std::string tempFilename = std::tmpnam(nullptr);
     std::cout << "tempFilename: " << tempFilename << std::endl;
     if (!l.verifySuff()) { indexes = false; std::cout << "FastLCP not good!" << std::endl; }
+    if (!l.verifyPathLengths()) { indexes = false; std::cout << "FastLCP path lengths not good!" << std::endl; }
+    FastRLCP rl(l);
+    if (!rl.verify(l)) { indexes = false; std::cout << "FastRLCP not good!" << std::endl; }
+    if (!verifySerializeLoad(tempFilename, rl, l)) { indexes = false; std::cout << "FastRLCP serialize/load not good!" << std::endl; }
     if (!lfg.verify(x)) {indexes = false; std::cout << "LF GBWT not good!" << std::endl; }
     if (!verifySerializeLoad(tempFilename, lfg, x)) {indexes = false; std::cout << "LF GBWT serialize/load not good!" << std::endl; }
     if (!ct.verifyText()) { indexes = false; std::cout << "CompText not good!" << std::endl; }
+    //cache about half of the suffixes so both cached and uncached nodes are queried
+    HotNodeCache hot(l, 1, (x.size()/2)*HotNodeCache::bytesPerSuffix());
+    if (!hot.verify(l)) { indexes = false; std::cout << "HotNodeCache not good!" << std::endl; }
+    if (x.bidirectional() && x.sequences() && !allVsAllEqual(x, r, l, lfg, ct, 1 + x.size()/x.sequences(), tempFilename)) { 
+        indexes = false; 
+        std::cout << "All-vs-All not good!" << std::endl; 
+    }
 
     std::random_device rd;
     unsigned seed = rd();
@@ -232,19 +820,81 @@ bool testIncremental(gbwt::GBWT & x, gbwt::FastLocate & r, FastLCP & l, lf_gbwt:
             r = gbwt::FastLocate(x);
             l = FastLCP(r);
             if (!l.verifySuff()) { indexes = false; std::cout << "FastLCP not good!" << std::endl; }
+            if (!l.verifyPathLengths()) { indexes = false; std::cout << "FastLCP path lengths not good!" << std::endl; }
+            rl = FastRLCP(l);
+            if (!rl.verify(l)) { indexes = false; std::cout << "FastRLCP not good!" << std::endl; }
+            if (!verifySerializeLoad(tempFilename, rl, l)) { indexes = false; std::cout << "FastRLCP serialize/load not good!" << std::endl; }
             lfg = lf_gbwt::GBWT(x);
             if (!lfg.verify(x)) {indexes = false; std::cout << "LF GBWT not good!" << std::endl; }
             if (!verifySerializeLoad(tempFilename, lfg, x)) {indexes = false; std::cout << "LF GBWT serialize/load not good!" << std::endl; }
             ct.buildFullMemPruned(l);
             if (!ct.verifyText()) { indexes = false; std::cout << "CompText not good!" << std::endl; }
+            hot = HotNodeCache(l, 1, (x.size()/2)*HotNodeCache::bytesPerSuffix());
+            if (!hot.verify(l)) { indexes = false; std::cout << "HotNodeCache not good!" << std::endl; }
         }
         //printGBWTandRindex(std::cout, x, r, l, lfg, ct, std::max(3, logbase10(std::max(x.sequences(), x.sigma())) + 1));
-        result = queriesEqual(x, r, l, lfg, ct, Q = generateHaplotype(x, 0.05, 0.0, gen, alphabetSize));
+        result = queriesEqual(x, r, l, lfg, ct, Q = generateHaplotype(x, 0.05, 0.0, gen, alphabetSize), &hot, &rl);
         if (!result)
             std::cout << "Set Maximal Match Queries not equal! for Q = " << Q << "!" << std::endl;
-        longResult = longMatchQueriesEqual(x, r, l, lfg, ct, Q = generateHaplotype(x, 0.05, 0.0, gen, alphabetSize), gen, 9);
+        longResult = longMatchQueriesEqual(x, r, l, lfg, ct, Q = generateHaplotype(x, 0.05, 0.0, gen, alphabetSize), gen, 9, &hot);
         if (!longResult)
             std::cout << "Long Match Queries not equal! for Q = " << Q << "!" << std::endl;
+        if (!lfLocateQueriesEqual(lfg, r, l, ct, Q, 1 + Q.size()/4)) {
+            longResult = false;
+            std::cout << "LFLocate Queries not equal! for Q = " << Q << "!" << std::endl;
+        }
+        if (!parallelQueriesEqual(lfg, r, l, ct, Q, 1 + Q.size()/4, &hot)) {
+            longResult = false;
+            std::cout << "Parallel Queries not equal! for Q = " << Q << "!" << std::endl;
+        }
+        {
+            //every third sequence on average
+            std::vector<gbwt::size_type> sequences;
+            for (gbwt::size_type j = 0; j < x.sequences(); ++j)
+                if (gen() % 3 == 0)
+                    sequences.push_back(j);
+            HaplotypeFilter filter(l, sequences);
+            if (!filter.verify(l)) { indexes = false; std::cout << "HaplotypeFilter not good!" << std::endl; }
+            if (!filteredQueriesEqual(x, r, l, lfg, ct, filter, Q, 1 + Q.size()/4, gen, &hot)) {
+                longResult = false;
+                std::cout << "Filtered Queries not equal! for Q = " << Q << "!" << std::endl;
+            }
+            //every fourth sequence on average, like rebuilding the indexes without those haplotypes
+            std::vector<gbwt::size_type> excluded;
+            for (gbwt::size_type j = 0; j < x.sequences(); ++j)
+                if (gen() % 4 == 0)
+                    excluded.push_back(j);
+            if (!leaveOutQueriesEqual(x, r, l, lfg, ct, Q, 1 + Q.size()/4, excluded, &hot)) {
+                longResult = false;
+                std::cout << "Leave Out Queries not equal! for Q = " << Q << "!" << std::endl;
+            }
+        }
+        if (!orientationQueriesEqual(x, r, l, lfg, ct, Q, 1 + Q.size()/4, &hot)) {
+            longResult = false;
+            std::cout << "Both Orientation Queries not equal! for Q = " << Q << "!" << std::endl;
+        }
+        if (!groupedQueriesEqual(x, r, l, lfg, ct, Q, 1 + Q.size()/4, tempFilename)) {
+            longResult = false;
+            std::cout << "Grouped Queries not equal! for Q = " << Q << "!" << std::endl;
+        }
+        if (!splitQueriesEqual(x, r, l, lfg, ct, Q, 1 + Q.size()/4, gen, &hot)) {
+            longResult = false;
+            std::cout << "Split Queries not equal! for Q = " << Q << "!" << std::endl;
+        }
+        if (!plannerQueriesEqual(x, r, l, lfg, ct, Q, 1 + Q.size()/4, &hot)) {
+            longResult = false;
+            std::cout << "Planned Queries not equal! for Q = " << Q << "!" << std::endl;
+        }
+        std::vector<gbwt::vector_type> batch;
+        for (unsigned j = 0; j < 8; ++j)
+            batch.push_back(generateHaplotype(x, 0.05, 0.0, gen, alphabetSize));
+        //prefixes of a query share their virtual insertion with it
+        for (unsigned j = 0; j < 4 && Q.size(); ++j)
+            batch.emplace_back(Q.begin(), Q.begin() + 1 + gen() % Q.size());
+        if (!batchQueriesEqual(x, r, l, lfg, ct, batch, 1 + Q.size()/4)) {
+            longResult = false;
+            std::cout << "Batch Queries not equal!" << std::endl;
+        }
         overall = overall && result && longResult && indexes;
     }
     return overall;